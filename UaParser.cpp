@@ -1,340 +1,987 @@
 #include "UaParser"
 
-#include <yaml-cpp/yaml.h>
-
-#include <cassert>
-#include <cstdlib>
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
 #include <vector>
 
-#include "internal/AlternativeExpander.h"
-#include "internal/MakeUnique.h"
+#include "internal/ClientHints.h"
+#include "internal/Hash.h"
+#include "internal/ParserState.h"
 #include "internal/Pattern.h"
-#include "internal/ReplaceTemplate.h"
-#include "internal/SnippetIndex.h"
-#include "internal/SnippetMapping.h"
+#include "internal/SampleUserAgents.h"
+#include "internal/StageTimer.h"
 #include "internal/StringUtils.h"
 
 namespace {
 
-struct GenericStore {
-  uap_cpp::ReplaceTemplate replacement;
-  uap_cpp::Pattern regExpr;
-  int index{0};
-};
+using uap_cpp::AgentStore;
+using uap_cpp::Category;
+using uap_cpp::DeviceStore;
+using uap_cpp::GenericStoreComparator;
+using uap_cpp::ParserState;
+using uap_cpp::RuleOverlay;
+using uap_cpp::Stage;
+using uap_cpp::StatsCollector;
 
-struct DeviceStore : GenericStore {
-  uap_cpp::ReplaceTemplate brandReplacement;
-  uap_cpp::ReplaceTemplate modelReplacement;
-};
+/////////////
+// HELPERS //
+/////////////
 
-struct AgentStore : GenericStore {
-  uap_cpp::ReplaceTemplate majorVersionReplacement;
-  uap_cpp::ReplaceTemplate minorVersionReplacement;
-  uap_cpp::ReplaceTemplate patchVersionReplacement;
-  uap_cpp::ReplaceTemplate patchMinorVersionReplacement;
-};
+void reset(uap_cpp::Device& device) {
+  device.family.assign("Other", 5);
+  device.brand.clear();
+  device.model.clear();
+}
 
-struct GenericStoreComparator {
-  bool operator()(const GenericStore* lhs, const GenericStore* rhs) const {
-    return lhs->index < rhs->index;
-  }
-};
+void reset(uap_cpp::Agent& agent) {
+  agent.family.assign("Other", 5);
+  agent.major.clear();
+  agent.minor.clear();
+  agent.patch.clear();
+  agent.patch_minor.clear();
+}
 
-void fill_device_store(const YAML::Node& device_parser,
-                       std::vector<std::unique_ptr<DeviceStore>>& device_stores,
-                       uap_cpp::SnippetIndex& snippet_index,
-                       uap_cpp::SnippetMapping<const DeviceStore*>& mappings) {
-  device_stores.emplace_back(uap_cpp::make_unique<DeviceStore>());
-  DeviceStore& device = *device_stores.back();
-  device.index = device_stores.size();
-
-  std::string regex;
-  bool regex_flag = false;
-  for (auto it = device_parser.begin(); it != device_parser.end(); ++it) {
-    const auto& key = it->first.as<std::string>();
-    const auto& value = it->second.as<std::string>();
-    if (key == "regex") {
-      regex = value;
-    } else if (key == "regex_flag" && value == "i") {
-      regex_flag = true;
-    } else if (key == "device_replacement") {
-      device.replacement = value;
-    } else if (key == "model_replacement") {
-      device.modelReplacement = value;
-    } else if (key == "brand_replacement") {
-      device.brandReplacement = value;
-    } else {
-      assert(false);
-    }
+void fill(uap_cpp::Device& device,
+          const DeviceStore& d,
+          const uap_cpp::Match& m) {
+  if (d.replacement.empty() && m.size() > 1) {
+    device.family = m.get(1);
+  } else {
+    d.replacement.expand(m, device.family);
   }
+  trim(device.family);
 
-  device.regExpr.assign(regex, !regex_flag);
+  if (!d.brandReplacement.empty()) {
+    d.brandReplacement.expand(m, device.brand);
+    trim(device.brand);
+  }
 
-  for (const auto& e : uap_cpp::AlternativeExpander::expand(regex)) {
-    auto snippets = snippet_index.registerSnippets(e);
-    mappings.addMapping(snippets, &device);
+  if (d.modelReplacement.empty() && m.size() > 1) {
+    device.model = m.get(1);
+  } else {
+    d.modelReplacement.expand(m, device.model);
   }
+  trim(device.model);
 }
 
-void fill_agent_store(const YAML::Node& node,
-                      const std::string& repl,
-                      const std::string& major_repl,
-                      const std::string& minor_repl,
-                      const std::string& patch_repl,
-                      std::vector<std::unique_ptr<AgentStore>>& agent_stores,
-                      uap_cpp::SnippetIndex& snippet_index,
-                      uap_cpp::SnippetMapping<const AgentStore*>& mapping) {
-  agent_stores.emplace_back(uap_cpp::make_unique<AgentStore>());
-  AgentStore& agent_store = *agent_stores.back();
-  agent_store.index = agent_stores.size();
-
-  assert(node.Type() == YAML::NodeType::Map);
-  for (auto it = node.begin(); it != node.end(); ++it) {
-    const auto& key = it->first.as<std::string>();
-    const auto& value = it->second.as<std::string>();
-    if (key == "regex") {
-      agent_store.regExpr.assign(value);
+void fill(uap_cpp::Agent& agent,
+          const AgentStore& store,
+          const uap_cpp::Match& m) {
+  if (store.replacement.empty() && m.size() > 1) {
+    agent.family = m.get(1);
+  } else {
+    store.replacement.expand(m, agent.family);
+  }
+  trim(agent.family);
 
-      for (const auto& e : uap_cpp::AlternativeExpander::expand(value)) {
-        auto snippets = snippet_index.registerSnippets(e);
-        mapping.addMapping(snippets, &agent_store);
-      }
-    } else if (key == repl) {
-      agent_store.replacement = value;
-    } else if (key == major_repl && !value.empty()) {
-      if (value != "$2") {
-        agent_store.majorVersionReplacement = value;
-      }
-    } else if (key == minor_repl && !value.empty()) {
-      if (value != "$3") {
-        agent_store.minorVersionReplacement = value;
-      }
-    } else if (key == patch_repl && !value.empty()) {
-      if (value != "$4") {
-        agent_store.patchVersionReplacement = value;
-      }
-    } else {
-      // Ignore invalid key.
-    }
+  if (!store.majorVersionReplacement.empty()) {
+    store.majorVersionReplacement.expand(m, agent.major);
+  } else if (m.size() > 2) {
+    agent.major = m.get(2);
+  }
+  if (!store.minorVersionReplacement.empty()) {
+    store.minorVersionReplacement.expand(m, agent.minor);
+  } else if (m.size() > 3) {
+    agent.minor = m.get(3);
+  }
+  if (!store.patchVersionReplacement.empty()) {
+    store.patchVersionReplacement.expand(m, agent.patch);
+  } else if (m.size() > 4) {
+    agent.patch = m.get(4);
+  }
+  if (m.size() == 6 && (m.get(5).empty() || m.get(5)[0] != '.')) {
+    agent.patch_minor = m.get(5);
   }
 }
 
-struct UAStore {
-  explicit UAStore(const std::string& regexes_file_path) {
-    auto regexes = YAML::LoadFile(regexes_file_path);
+bool timed_match(const uap_cpp::GenericStore& store,
+                 std::string_view ua,
+                 uap_cpp::Match& m,
+                 StatsCollector::CategoryCounters& counters) {
+  auto start = std::chrono::steady_clock::now();
+  bool matched = store.regExpr.match(ua, m);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  auto& rule = counters.rules[store.index - 1];
+  StatsCollector::add(rule.evaluations, 1);
+  StatsCollector::add(
+      rule.matchNanoseconds,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  if (matched) {
+    StatsCollector::add(rule.matches, 1);
+  }
+  return matched;
+}
 
-    const auto& user_agent_parsers = regexes["user_agent_parsers"];
-    for (const auto& user_agent : user_agent_parsers) {
-      fill_agent_store(user_agent,
-                       "family_replacement",
-                       "v1_replacement",
-                       "v2_replacement",
-                       "v3_replacement",
-                       browserStore,
-                       browserSnippetIndex,
-                       browserMapping);
+/**
+ * Work limits of one parse, shared by its categories
+ */
+class ParseBudget {
+ public:
+  explicit ParseBudget(const uap_cpp::ParserOptions& options)
+      : maxLength_(options.max_length),
+        maxCandidates_(options.max_candidates),
+        hasDeadline_(options.time_budget_nanoseconds != 0) {
+    if (hasDeadline_) {
+      deadline_ = std::chrono::steady_clock::now() +
+                  std::chrono::nanoseconds(options.time_budget_nanoseconds);
     }
+  }
 
-    const auto& os_parsers = regexes["os_parsers"];
-    for (const auto& o : os_parsers) {
-      fill_agent_store(o,
-                       "os_replacement",
-                       "os_v1_replacement",
-                       "os_v2_replacement",
-                       "os_v3_replacement",
-                       osStore,
-                       osSnippetIndex,
-                       osMapping);
+  /**
+   * Applies the length limit to the user agent
+   */
+  std::string_view truncate(std::string_view ua) {
+    if (maxLength_ && ua.size() > maxLength_) {
+      hit.length = true;
+      return ua.substr(0, maxLength_);
     }
+    return ua;
+  }
 
-    const auto& device_parsers = regexes["device_parsers"];
-    for (const auto& device_parser : device_parsers) {
-      fill_device_store(
-          device_parser, deviceStore, deviceSnippetIndex, deviceMapping);
+  bool allowsCandidate(size_t evaluated) {
+    if (maxCandidates_ && evaluated >= maxCandidates_) {
+      hit.candidates = true;
+      return false;
     }
+    return !expired();
   }
 
-  std::vector<std::unique_ptr<DeviceStore>> deviceStore;
-  std::vector<std::unique_ptr<AgentStore>> osStore;
-  std::vector<std::unique_ptr<AgentStore>> browserStore;
+  bool expired() {
+    if (hasDeadline_ && !hit.time &&
+        std::chrono::steady_clock::now() > deadline_) {
+      hit.time = true;
+    }
+    return hit.time;
+  }
 
-  uap_cpp::SnippetIndex deviceSnippetIndex;
-  uap_cpp::SnippetIndex osSnippetIndex;
-  uap_cpp::SnippetIndex browserSnippetIndex;
+  uap_cpp::LimitsHit hit;
 
-  uap_cpp::SnippetMapping<const DeviceStore*> deviceMapping;
-  uap_cpp::SnippetMapping<const AgentStore*> osMapping;
-  uap_cpp::SnippetMapping<const AgentStore*> browserMapping;
+ private:
+  const size_t maxLength_;
+  const size_t maxCandidates_;
+  const bool hasDeadline_;
+  std::chrono::steady_clock::time_point deadline_;
 };
 
-/////////////
-// HELPERS //
-/////////////
-
-uap_cpp::Device parse_device_impl(const std::string& ua,
-                                  const UAStore* ua_store) {
-  uap_cpp::Device device;
+/**
+ * Finds the candidate rules of the category, and fills the result from the
+ * first one (in regexes.yaml order) that matches within the budget. Returns
+ * whether a rule matched. filter and counters may be null.
+ */
+template <class Store, class Result>
+bool parse_category(std::string_view ua,
+                    const uap_cpp::SnippetIndex& snippet_index,
+                    const uap_cpp::SnippetMapping<const Store*>& mapping,
+                    Category category,
+                    const uap_cpp::NoMatchFilter* filter,
+                    StatsCollector::CategoryCounters* counters,
+                    const ParserState& state,
+                    ParseBudget& budget,
+                    Result& result) {
+  reset(result);
+  if (budget.expired()) {
+    return false;
+  }
 
-  auto snippets = ua_store->deviceSnippetIndex.getSnippets(ua);
+  if (filter && !filter->mayMatch(ua)) {
+    if (counters) {
+      StatsCollector::add(counters->parses, 1);
+      StatsCollector::add(counters->noMatch, 1);
+      StatsCollector::add(counters->candidateHistogram[0], 1);
+    }
+    return false;
+  }
 
-  std::set<const DeviceStore*, GenericStoreComparator> regexps;
-  ua_store->deviceMapping.getExpressions(snippets, regexps);
+  uap_cpp::StageTimer timer(state.options.stage_hook, category);
+  auto snippets = snippet_index.getSnippets(ua);
+  timer.lap(Stage::kSnippets);
+
+  std::set<const Store*, GenericStoreComparator> regexps;
+  mapping.getExpressions(snippets, regexps);
+  timer.lap(Stage::kCandidates);
+
+  if (counters) {
+    StatsCollector::add(counters->parses, 1);
+    StatsCollector::add(
+        counters->candidateHistogram[StatsCollector::histogramBucket(
+            regexps.size())],
+        1);
+    for (const auto& entry : regexps) {
+      StatsCollector::add(counters->rules[entry->index - 1].candidates, 1);
+    }
+  }
 
+  thread_local uap_cpp::Match m;
+  const Store* winner = nullptr;
+  size_t evaluated = 0;
   for (const auto& entry : regexps) {
-    const auto& d = *entry;
-
-    thread_local uap_cpp::Match m;
-
-    if (d.regExpr.match(ua, m)) {
-      if (d.replacement.empty() && m.size() > 1) {
-        device.family = m.get(1);
-      } else {
-        device.family = d.replacement.expand(m);
-      }
-      trim(device.family);
-
-      if (!d.brandReplacement.empty()) {
-        device.brand = d.brandReplacement.expand(m);
-        trim(device.brand);
-      }
-
-      if (d.modelReplacement.empty() && m.size() > 1) {
-        device.model = m.get(1);
-      } else {
-        device.model = d.modelReplacement.expand(m);
-      }
-      trim(device.model);
-
+    if (!budget.allowsCandidate(evaluated++)) {
+      break;
+    }
+    bool matched = counters ? timed_match(*entry, ua, m, *counters)
+                            : entry->regExpr.match(ua, m);
+    if (matched) {
+      winner = entry;
       break;
     }
   }
+  timer.lap(Stage::kMatch);
 
-  return device;
+  if (!winner) {
+    return false;
+  }
+  fill(result, *winner, m);
+  timer.lap(Stage::kReplace);
+  return true;
 }
 
-template <class AGENT, class AGENT_STORE>
-void fill_agent(AGENT& agent,
-                const AGENT_STORE& store,
-                const uap_cpp::Match& m) {
-  if (store.replacement.empty() && m.size() > 1) {
-    agent.family = m.get(1);
+/**
+ * Parses the category with the parser rules and, if set, the overlay rules
+ * in the order of the overlay position. Overlay rules have no filter and are
+ * not counted in stats.
+ */
+template <class Store, class Result>
+void parse_with_overlay(
+    std::string_view ua,
+    uap_cpp::SnippetIndex uap_cpp::UAStore::*snippet_index,
+    uap_cpp::SnippetMapping<const Store*> uap_cpp::UAStore::*mapping,
+    Category category,
+    const ParserState& state,
+    const RuleOverlay* overlay,
+    ParseBudget& budget,
+    Result& result) {
+  auto parse_base = [&] {
+    return parse_category(ua,
+                          state.store.*snippet_index,
+                          state.store.*mapping,
+                          category,
+                          state.filter(category),
+                          state.counters(category),
+                          state,
+                          budget,
+                          result);
+  };
+  auto parse_overlay = [&] {
+    return parse_category(ua,
+                          overlay->store.*snippet_index,
+                          overlay->store.*mapping,
+                          category,
+                          nullptr,
+                          nullptr,
+                          state,
+                          budget,
+                          result);
+  };
+
+  if (!overlay) {
+    parse_base();
+  } else if (overlay->position == uap_cpp::OverlayPosition::kBefore) {
+    parse_overlay() || parse_base();
   } else {
-    agent.family = store.replacement.expand(m);
+    parse_base() || parse_overlay();
   }
-  trim(agent.family);
+}
 
-  if (!store.majorVersionReplacement.empty()) {
-    agent.major = store.majorVersionReplacement.expand(m);
-  } else if (m.size() > 2) {
-    agent.major = m.get(2);
-  }
-  if (!store.minorVersionReplacement.empty()) {
-    agent.minor = store.minorVersionReplacement.expand(m);
-  } else if (m.size() > 3) {
-    agent.minor = m.get(3);
-  }
-  if (!store.patchVersionReplacement.empty()) {
-    agent.patch = store.patchVersionReplacement.expand(m);
-  } else if (m.size() > 4) {
-    agent.patch = m.get(4);
+void parse_device_impl(std::string_view ua,
+                       const ParserState& state,
+                       const RuleOverlay* overlay,
+                       ParseBudget& budget,
+                       uap_cpp::Device& device) {
+  parse_with_overlay(ua,
+                     &uap_cpp::UAStore::deviceSnippetIndex,
+                     &uap_cpp::UAStore::deviceMapping,
+                     Category::kDevice,
+                     state,
+                     overlay,
+                     budget,
+                     device);
+}
+
+void parse_os_impl(std::string_view ua,
+                   const ParserState& state,
+                   const RuleOverlay* overlay,
+                   ParseBudget& budget,
+                   uap_cpp::Agent& os) {
+  parse_with_overlay(ua,
+                     &uap_cpp::UAStore::osSnippetIndex,
+                     &uap_cpp::UAStore::osMapping,
+                     Category::kOs,
+                     state,
+                     overlay,
+                     budget,
+                     os);
+}
+
+void parse_browser_impl(std::string_view ua,
+                        const ParserState& state,
+                        const RuleOverlay* overlay,
+                        ParseBudget& budget,
+                        uap_cpp::Agent& browser) {
+  parse_with_overlay(ua,
+                     &uap_cpp::UAStore::browserSnippetIndex,
+                     &uap_cpp::UAStore::browserMapping,
+                     Category::kBrowser,
+                     state,
+                     overlay,
+                     budget,
+                     browser);
+}
+
+/**
+ * Parses all categories under the limits of the parser options
+ */
+void parse_impl(std::string_view ua,
+                const ParserState& state,
+                const RuleOverlay* overlay,
+                uap_cpp::UserAgent& result) {
+  ParseBudget budget(state.options);
+  auto parsed_ua = budget.truncate(ua);
+  parse_device_impl(parsed_ua, state, overlay, budget, result.device);
+  parse_os_impl(parsed_ua, state, overlay, budget, result.os);
+  parse_browser_impl(parsed_ua, state, overlay, budget, result.browser);
+  result.ua_string.assign(ua.data(), ua.size());
+  result.limits_hit = budget.hit;
+}
+
+/**
+ * Looks ua up in a result cache, if there is one, counting hits and misses
+ * when stats are collected
+ */
+template <class Cache>
+bool find_cached(const ParserState& state,
+                 const Cache* cache,
+                 std::atomic<uint64_t> StatsCollector::ThreadCounters::*hits,
+                 std::atomic<uint64_t> StatsCollector::ThreadCounters::*misses,
+                 std::string_view ua,
+                 uint64_t hash,
+                 uap_cpp::UserAgent& result) {
+  if (!cache) {
+    return false;
   }
-  if (m.size() == 6 && (m.get(5).empty() || m.get(5)[0] != '.')) {
-    agent.patch_minor = m.get(5);
+  const bool hit = cache->find(ua, hash, result);
+  if (state.stats) {
+    StatsCollector::add(state.stats->local().*(hit ? hits : misses), 1);
   }
+  return hit;
 }
 
-uap_cpp::Agent parse_browser_impl(const std::string& ua,
-                                  const UAStore* ua_store) {
-  uap_cpp::Agent browser;
+uint64_t nanoseconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
 
-  auto snippets = ua_store->browserSnippetIndex.getSnippets(ua);
+/**
+ * Same as parse_category, recording each step in explanation
+ */
+template <class Store, class Result>
+void explain_category(std::string_view ua,
+                      const uap_cpp::SnippetIndex& snippet_index,
+                      const uap_cpp::SnippetMapping<const Store*>& mapping,
+                      Result& result,
+                      uap_cpp::CategoryExplanation& explanation) {
+  reset(result);
+
+  auto start = std::chrono::steady_clock::now();
+  auto snippets = snippet_index.getSnippets(ua);
+  explanation.snippets_nanoseconds = nanoseconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  std::set<const Store*, GenericStoreComparator> regexps;
+  mapping.getExpressions(snippets, regexps);
+  explanation.candidates_nanoseconds = nanoseconds_since(start);
+
+  const auto registered = snippet_index.getRegisteredSnippets();
+  for (auto id : snippets) {
+    auto it = registered.find(id);
+    explanation.snippets.push_back(
+        {id, it != registered.end() ? it->second : std::string()});
+  }
 
-  std::set<const AgentStore*, GenericStoreComparator> regexps;
-  ua_store->browserMapping.getExpressions(snippets, regexps);
+  for (const auto& entry : regexps) {
+    uap_cpp::ExplainedRule rule;
+    rule.index = entry->index - 1;
+    rule.regex = entry->regExpr.pattern();
+    explanation.candidates.push_back(std::move(rule));
+  }
 
+  uap_cpp::Match m;
+  size_t position = 0;
   for (const auto& entry : regexps) {
-    const auto& b = *entry;
-    thread_local uap_cpp::Match m;
-    if (b.regExpr.match(ua, m)) {
-      fill_agent(browser, b, m);
+    auto& rule = explanation.candidates[position];
+    start = std::chrono::steady_clock::now();
+    rule.evaluated = true;
+    rule.matched = entry->regExpr.match(ua, m);
+    rule.nanoseconds = nanoseconds_since(start);
+    explanation.match_nanoseconds += rule.nanoseconds;
+
+    if (rule.matched) {
+      explanation.winner = static_cast<int>(position);
+      start = std::chrono::steady_clock::now();
+      fill(result, *entry, m);
+      explanation.replace_nanoseconds = nanoseconds_since(start);
       break;
     }
+    ++position;
+  }
+}
+
+template <class Store>
+uap_cpp::CategoryStats category_stats(
+    const StatsCollector& collector,
+    Category category,
+    const std::vector<Store>& stores) {
+  uap_cpp::CategoryStats stats;
+  stats.candidates_histogram.assign(StatsCollector::HISTOGRAM_BUCKETS, 0);
+  stats.rules.resize(stores.size());
+  for (size_t i = 0; i < stores.size(); ++i) {
+    stats.rules[i].index = i;
+    stats.rules[i].regex = stores[i].regExpr.pattern();
   }
 
-  return browser;
+  collector.forEachThread([&](const StatsCollector::ThreadCounters& t) {
+    const auto& counters = t.categories[static_cast<size_t>(category)];
+    stats.parses += StatsCollector::get(counters.parses);
+    stats.no_match += StatsCollector::get(counters.noMatch);
+    for (size_t i = 0; i < StatsCollector::HISTOGRAM_BUCKETS; ++i) {
+      stats.candidates_histogram[i] +=
+          StatsCollector::get(counters.candidateHistogram[i]);
+    }
+    for (size_t i = 0; i < stores.size(); ++i) {
+      const auto& rule = counters.rules[i];
+      stats.rules[i].candidates += StatsCollector::get(rule.candidates);
+      stats.rules[i].evaluations += StatsCollector::get(rule.evaluations);
+      stats.rules[i].matches += StatsCollector::get(rule.matches);
+      stats.rules[i].match_nanoseconds +=
+          StatsCollector::get(rule.matchNanoseconds);
+    }
+  });
+  return stats;
 }
 
-uap_cpp::Agent parse_os_impl(const std::string& ua, const UAStore* ua_store) {
-  uap_cpp::Agent os;
+size_t replacement_bytes(const DeviceStore& store) {
+  return store.replacement.memoryUsage() +
+         store.brandReplacement.memoryUsage() +
+         store.modelReplacement.memoryUsage();
+}
 
-  auto snippets = ua_store->osSnippetIndex.getSnippets(ua);
+size_t replacement_bytes(const AgentStore& store) {
+  return store.replacement.memoryUsage() +
+         store.majorVersionReplacement.memoryUsage() +
+         store.minorVersionReplacement.memoryUsage() +
+         store.patchVersionReplacement.memoryUsage() +
+         store.patchMinorVersionReplacement.memoryUsage();
+}
 
-  std::set<const AgentStore*, GenericStoreComparator> regexps;
-  ua_store->osMapping.getExpressions(snippets, regexps);
+/**
+ * Rule of any category, to rank regexes by cost before copying their text
+ */
+struct RankedPattern {
+  size_t programSize;
+  Category category;
+  size_t index;
+  const uap_cpp::Pattern* pattern;
+};
 
-  for (const auto& entry : regexps) {
-    const auto& o = *entry;
-    thread_local uap_cpp::Match m;
-    if (o.regExpr.match(ua, m)) {
-      fill_agent(os, o, m);
-      break;
+template <class Store>
+uap_cpp::CategoryMemory category_memory(
+    Category category,
+    const std::vector<Store>& stores,
+    const uap_cpp::SnippetIndex& snippet_index,
+    const uap_cpp::SnippetMapping<const Store*>& mapping,
+    const uap_cpp::NoMatchFilter* filter,
+    std::vector<RankedPattern>& patterns) {
+  uap_cpp::CategoryMemory memory;
+  memory.snippet_index_bytes =
+      sizeof(snippet_index) + snippet_index.memoryUsage();
+  memory.snippet_mapping_bytes = sizeof(mapping) + mapping.memoryUsage();
+  memory.rules_bytes = stores.capacity() * sizeof(Store);
+  for (size_t i = 0; i < stores.size(); ++i) {
+    const auto& regex = stores[i].regExpr;
+    memory.rules_bytes += replacement_bytes(stores[i]);
+    memory.regex_bytes += regex.memoryUsage();
+    memory.regex_program_size += regex.programSize();
+    memory.regexes_over_budget += regex.overBudget();
+    patterns.push_back({regex.programSize(), category, i, &regex});
+  }
+  if (filter) {
+    memory.no_match_filter_bytes = filter->memoryUsage();
+  }
+  return memory;
+}
+
+/**
+ * Custom rules as RuleDefinitions, with the replacements in regexes.yaml
+ * order for the category
+ */
+std::vector<uap_cpp::RuleDefinition> rule_definitions(
+    const std::vector<uap_cpp::CustomRule>& rules,
+    bool device) {
+  std::vector<uap_cpp::RuleDefinition> definitions;
+  definitions.reserve(rules.size());
+  for (const auto& rule : rules) {
+    definitions.emplace_back();
+    auto& definition = definitions.back();
+    definition.regex = rule.regex;
+    definition.caseInsensitive = rule.case_insensitive;
+    definition.replacements[0] = rule.family;
+    if (device) {
+      definition.replacements[1] = rule.brand;
+      definition.replacements[2] = rule.model;
+    } else {
+      definition.replacements[1] = rule.major;
+      definition.replacements[2] = rule.minor;
+      definition.replacements[3] = rule.patch;
     }
   }
+  return definitions;
+}
 
-  return os;
+uap_cpp::RuleDefinitions rule_definitions(const uap_cpp::CustomRules& rules) {
+  uap_cpp::RuleDefinitions definitions;
+  definitions.device = rule_definitions(rules.device, true);
+  definitions.os = rule_definitions(rules.os, false);
+  definitions.browser = rule_definitions(rules.browser, false);
+  return definitions;
 }
 
 }  // namespace
 
 namespace uap_cpp {
 
+bool stage_hooks_enabled() noexcept {
+#ifdef UAP_CPP_STAGE_HOOKS
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool has_builtin_rules() noexcept {
+#ifdef UAP_CPP_BUILTIN_RULES
+  return true;
+#else
+  return false;
+#endif
+}
+
 UserAgentParser::UserAgentParser(const std::string& regexes_file_path)
+    : UserAgentParser(regexes_file_path, ParserOptions()) {}
+
+UserAgentParser::UserAgentParser(const std::string& regexes_file_path,
+                                 const ParserOptions& options)
     : regexes_file_path_{regexes_file_path} {
-  ua_store_ = new UAStore(regexes_file_path);
+  state_ = new ParserState(regexes_file_path, options);
+}
+
+UserAgentParser::UserAgentParser() : UserAgentParser(ParserOptions()) {}
+
+UserAgentParser::UserAgentParser(const ParserOptions& options) {
+#ifdef UAP_CPP_BUILTIN_RULES
+  state_ = new ParserState(builtin_rules(), options);
+#else
+  (void)options;
+  throw std::runtime_error(
+      "uap-cpp was built without built-in rules, see the BUILTIN_RULES CMake "
+      "option");
+#endif
 }
 
 UserAgentParser::~UserAgentParser() {
-  delete static_cast<const UAStore*>(ua_store_);
+  delete static_cast<const ParserState*>(state_);
 }
 
 UserAgent UserAgentParser::parse(const std::string& ua) const noexcept {
-  const auto ua_store = static_cast<const UAStore*>(ua_store_);
+  UserAgent result;
+  parse(ua, result);
+  return result;
+}
+
+void UserAgentParser::parse(std::string_view ua,
+                            UserAgent& result) const noexcept {
+  const auto& state = *static_cast<const ParserState*>(state_);
+
+  if (!ua.data()) {
+    // StringView treats a null end as a NUL-terminated string
+    ua = std::string_view("", 0);
+  }
 
   try {
-    const auto device = parse_device_impl(ua, ua_store);
-    const auto os = parse_os_impl(ua, ua_store);
-    const auto browser = parse_browser_impl(ua, ua_store);
-    return {device, os, browser, ua};
+    const auto overlay = state.overlay();
+    const uint64_t fingerprint =
+        overlay ? overlay->fingerprint : state.store.fingerprint;
+
+    uint64_t hash = 0;
+    if (state.sharedCache || state.warmCache || state.hotUserAgents) {
+      hash = hash64(ua, fingerprint);
+    }
+    if (state.hotUserAgents) {
+      state.hotUserAgents->record(ua, hash);
+    }
+    // The warm cache only holds results of the rules it was saved with
+    const WarmCache* warm_cache =
+        state.warmCache && state.warmCache->fingerprint() == fingerprint
+            ? state.warmCache.get()
+            : nullptr;
+    if (find_cached(state,
+                    warm_cache,
+                    &StatsCollector::ThreadCounters::warmCacheHits,
+                    &StatsCollector::ThreadCounters::warmCacheMisses,
+                    ua,
+                    hash,
+                    result) ||
+        find_cached(state,
+                    state.sharedCache.get(),
+                    &StatsCollector::ThreadCounters::sharedCacheHits,
+                    &StatsCollector::ThreadCounters::sharedCacheMisses,
+                    ua,
+                    hash,
+                    result)) {
+      return;
+    }
+
+    parse_impl(ua, state, overlay.get(), result);
+
+    // Results cut short by a limit depend on timing, they are not cached
+    if (state.sharedCache && !result.limits_hit.any()) {
+      state.sharedCache->insert(ua, hash, result);
+    }
   } catch (...) {
-    return {Device(), Agent(), Agent(), ""};
+    reset(result.device);
+    reset(result.os);
+    reset(result.browser);
+    result.ua_string.clear();
+    result.limits_hit = LimitsHit();
+  }
+}
+
+UserAgent UserAgentParser::parse(const std::string& ua,
+                                 const ClientHints& hints) const noexcept {
+  UserAgent result;
+  parse(ua, hints, result);
+  return result;
+}
+
+void UserAgentParser::parse(std::string_view ua,
+                            const ClientHints& hints,
+                            UserAgent& result) const noexcept {
+  const auto& state = *static_cast<const ParserState*>(state_);
+
+  if (!ua.data()) {
+    ua = std::string_view("", 0);
+  }
+
+  try {
+    const auto overlay = state.overlay();
+    ParseBudget budget(state.options);
+    auto parsed_ua = budget.truncate(ua);
+    // Hints stand in for the parser rules, so rules meant to take precedence
+    // over those disable them
+    const bool use_hints =
+        !overlay || overlay->position == OverlayPosition::kAfter;
+    // Kept per thread, so that repeated calls do not allocate
+    thread_local std::string device_ua;
+    bool device_from_hints = false;
+    if (use_hints && ClientHintsParser::deviceUserAgent(hints, device_ua)) {
+      parse_device_impl(budget.truncate(device_ua),
+                        state,
+                        overlay.get(),
+                        budget,
+                        result.device);
+      device_from_hints = result.device.family != "Other";
+    }
+    if (!device_from_hints) {
+      parse_device_impl(
+          parsed_ua, state, overlay.get(), budget, result.device);
+    }
+    if (!use_hints || !ClientHintsParser::parseOs(hints, result.os)) {
+      parse_os_impl(parsed_ua, state, overlay.get(), budget, result.os);
+    }
+    if (!use_hints || !ClientHintsParser::parseBrowser(hints, result.browser)) {
+      parse_browser_impl(
+          parsed_ua, state, overlay.get(), budget, result.browser);
+    }
+    result.ua_string.assign(ua.data(), ua.size());
+    result.limits_hit = budget.hit;
+  } catch (...) {
+    reset(result.device);
+    reset(result.os);
+    reset(result.browser);
+    result.ua_string.clear();
+    result.limits_hit = LimitsHit();
+  }
+}
+
+bool UserAgentParser::parse_async(
+    std::string ua,
+    std::function<void(UserAgent&&)> callback) const {
+  return static_cast<const ParserState*>(state_)->async(*this).submit(
+      std::move(ua), std::move(callback));
+}
+
+std::future<UserAgent> UserAgentParser::parse_async(std::string ua) const {
+  // std::function needs a copyable callback
+  auto promise = std::make_shared<std::promise<UserAgent>>();
+  auto future = promise->get_future();
+  if (!parse_async(std::move(ua), [promise](UserAgent&& result) {
+        promise->set_value(std::move(result));
+      })) {
+    return std::future<UserAgent>();
   }
+  return future;
 }
 
 Device UserAgentParser::parse_device(const std::string& ua) const noexcept {
+  Device device;
   try {
-    return parse_device_impl(ua, static_cast<const UAStore*>(ua_store_));
+    const auto& state = *static_cast<const ParserState*>(state_);
+    ParseBudget budget(state.options);
+    parse_device_impl(
+        budget.truncate(ua), state, state.overlay().get(), budget, device);
   } catch (...) {
-    return Device();
+    reset(device);
   }
+  return device;
 }
 
 Agent UserAgentParser::parse_os(const std::string& ua) const noexcept {
+  Agent os;
   try {
-    return parse_os_impl(ua, static_cast<const UAStore*>(ua_store_));
+    const auto& state = *static_cast<const ParserState*>(state_);
+    ParseBudget budget(state.options);
+    parse_os_impl(
+        budget.truncate(ua), state, state.overlay().get(), budget, os);
   } catch (...) {
-    return Agent();
+    reset(os);
   }
+  return os;
 }
 
 Agent UserAgentParser::parse_browser(const std::string& ua) const noexcept {
+  Agent browser;
   try {
-    return parse_browser_impl(ua, static_cast<const UAStore*>(ua_store_));
+    const auto& state = *static_cast<const ParserState*>(state_);
+    ParseBudget budget(state.options);
+    parse_browser_impl(
+        budget.truncate(ua), state, state.overlay().get(), budget, browser);
   } catch (...) {
-    return Agent();
+    reset(browser);
+  }
+  return browser;
+}
+
+ParserStats UserAgentParser::stats() const {
+  const auto& state = *static_cast<const ParserState*>(state_);
+
+  ParserStats stats;
+  if (state.stats) {
+    stats.device = category_stats(
+        *state.stats, Category::kDevice, state.store.deviceStore);
+    stats.os = category_stats(*state.stats, Category::kOs, state.store.osStore);
+    stats.browser = category_stats(
+        *state.stats, Category::kBrowser, state.store.browserStore);
+    state.stats->forEachThread([&](const StatsCollector::ThreadCounters& t) {
+      stats.shared_cache_hits += StatsCollector::get(t.sharedCacheHits);
+      stats.shared_cache_misses += StatsCollector::get(t.sharedCacheMisses);
+      stats.warm_cache_hits += StatsCollector::get(t.warmCacheHits);
+      stats.warm_cache_misses += StatsCollector::get(t.warmCacheMisses);
+    });
+  }
+  return stats;
+}
+
+Explanation UserAgentParser::explain(std::string_view ua) const {
+  const auto& store = static_cast<const ParserState*>(state_)->store;
+
+  if (!ua.data()) {
+    ua = std::string_view("", 0);
+  }
+
+  Explanation explanation;
+  explain_category(ua,
+                   store.deviceSnippetIndex,
+                   store.deviceMapping,
+                   explanation.result.device,
+                   explanation.device);
+  explain_category(ua,
+                   store.osSnippetIndex,
+                   store.osMapping,
+                   explanation.result.os,
+                   explanation.os);
+  explain_category(ua,
+                   store.browserSnippetIndex,
+                   store.browserMapping,
+                   explanation.result.browser,
+                   explanation.browser);
+  explanation.result.ua_string.assign(ua.data(), ua.size());
+  return explanation;
+}
+
+MemoryUsage UserAgentParser::memory_usage(size_t largest_patterns) const {
+  const auto& state = *static_cast<const ParserState*>(state_);
+  const auto& store = state.store;
+
+  MemoryUsage memory;
+  std::vector<RankedPattern> patterns;
+  memory.device = category_memory(Category::kDevice,
+                                  store.deviceStore,
+                                  store.deviceSnippetIndex,
+                                  store.deviceMapping,
+                                  state.filter(Category::kDevice),
+                                  patterns);
+  memory.os = category_memory(Category::kOs,
+                              store.osStore,
+                              store.osSnippetIndex,
+                              store.osMapping,
+                              state.filter(Category::kOs),
+                              patterns);
+  memory.browser = category_memory(Category::kBrowser,
+                                   store.browserStore,
+                                   store.browserSnippetIndex,
+                                   store.browserMapping,
+                                   state.filter(Category::kBrowser),
+                                   patterns);
+  if (state.sharedCache) {
+    memory.shared_cache_bytes = state.sharedCache->mappedBytes();
+  }
+  if (state.warmCache) {
+    memory.warm_cache_bytes = state.warmCache->mappedBytes();
+  }
+  if (state.hotUserAgents) {
+    memory.hot_user_agents_bytes = state.hotUserAgents->memoryUsage();
+  }
+  if (state.stats) {
+    memory.stats_bytes = state.stats->memoryUsage();
+  }
+
+  largest_patterns = std::min(largest_patterns, patterns.size());
+  std::partial_sort(patterns.begin(),
+                    patterns.begin() + largest_patterns,
+                    patterns.end(),
+                    [](const RankedPattern& a, const RankedPattern& b) {
+                      return a.programSize > b.programSize;
+                    });
+  for (size_t i = 0; i < largest_patterns; ++i) {
+    const auto& p = patterns[i];
+    memory.largest_patterns.push_back({p.category,
+                                       p.index,
+                                       p.pattern->pattern(),
+                                       p.programSize,
+                                       p.pattern->memoryUsage()});
+  }
+  return memory;
+}
+
+size_t UserAgentParser::save_warm_cache(const std::string& path,
+                                        size_t max_entries) const {
+  const auto& state = *static_cast<const ParserState*>(state_);
+  if (!state.hotUserAgents) {
+    throw std::runtime_error(
+        "save_warm_cache() needs ParserOptions::hot_user_agents");
+  }
+
+  const auto overlay = state.overlay();
+  std::vector<std::pair<std::string, UserAgent>> results;
+  for (auto& ua : state.hotUserAgents->top(max_entries)) {
+    UserAgent result;
+    parse_impl(ua, state, overlay.get(), result);
+    if (!result.limits_hit.any()) {
+      results.emplace_back(std::move(ua), std::move(result));
+    }
   }
+  return WarmCache::save(
+      path, overlay ? overlay->fingerprint : state.store.fingerprint, results);
+}
+
+WarmUpReport UserAgentParser::warm_up(const std::vector<std::string>& corpus,
+                                      size_t threads) const {
+  const auto& state = *static_cast<const ParserState*>(state_);
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::string_view> user_agents;
+  if (corpus.empty()) {
+    user_agents.assign(uap_cpp::SAMPLE_USER_AGENTS,
+                       uap_cpp::SAMPLE_USER_AGENTS +
+                           uap_cpp::SAMPLE_USER_AGENT_COUNT);
+  } else {
+    user_agents.assign(corpus.begin(), corpus.end());
+  }
+  threads = std::max<size_t>(1, std::min(threads, user_agents.size()));
+
+  // Threads take user agents in turn, so that however many of them start,
+  // the whole corpus is parsed
+  std::atomic<size_t> next{0};
+  auto work = [&] {
+    const auto overlay = state.overlay();
+    UserAgent result;
+    for (size_t i = next++; i < user_agents.size(); i = next++) {
+      try {
+        parse_impl(user_agents[i], state, overlay.get(), result);
+      } catch (...) {
+        // As in parse(), an input that fails is left unparsed
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  for (size_t i = 1; i < threads; ++i) {
+    try {
+      workers.emplace_back(work);
+    } catch (const std::system_error&) {
+      // Out of threads: the ones already started do the rest
+      break;
+    }
+  }
+  work();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  state.warm.store(true, std::memory_order_release);
+
+  WarmUpReport report;
+  report.user_agents = user_agents.size();
+  report.threads = workers.size() + 1;
+  report.nanoseconds = nanoseconds_since(start);
+  return report;
+}
+
+bool UserAgentParser::ready() const noexcept {
+  return static_cast<const ParserState*>(state_)->warm.load(
+      std::memory_order_acquire);
+}
+
+void UserAgentParser::set_overlay(const std::string& regexes_file_path,
+                                  OverlayPosition position) {
+  const auto& state = *static_cast<const ParserState*>(state_);
+  state.setOverlay(std::make_shared<const RuleOverlay>(
+      uap_cpp::RuleDefinitions::load(regexes_file_path),
+      position,
+      state.options,
+      state.store.fingerprint));
+}
+
+void UserAgentParser::set_overlay(const CustomRules& rules,
+                                  OverlayPosition position) {
+  const auto& state = *static_cast<const ParserState*>(state_);
+  state.setOverlay(std::make_shared<const RuleOverlay>(rule_definitions(rules),
+                                                      position,
+                                                      state.options,
+                                                      state.store.fingerprint));
+}
+
+void UserAgentParser::clear_overlay() {
+  static_cast<const ParserState*>(state_)->setOverlay(nullptr);
 }
 
 DeviceType UserAgentParser::device_type(const std::string& ua) noexcept {
@@ -3,12 +3,27 @@
 
 #include "UaParser"
 #include "internal/AlternativeExpander.h"
+#include "internal/BlockPipeline.h"
+#include "internal/ClientHints.h"
+#include "internal/ParserServer.h"
 #include "internal/Pattern.h"
 #include "internal/ReplaceTemplate.h"
+#include "internal/ResultWriter.h"
+#include "internal/RuleSubset.h"
+#include "internal/SampleUserAgents.h"
+#include "internal/ServerProtocol.h"
 #include "internal/SnippetIndex.h"
-#ifdef WITH_MT_TEST
+#include "internal/UAStore.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <future>
-#endif  // WITH_MT_TEST
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 namespace {
 
@@ -42,6 +57,1014 @@ TEST(UserAgentParser, basic) {
   ASSERT_FALSE(uagent.isSpider());
 }
 
+TEST(UserAgentParser, parse_into_existing_result) {
+  uap_cpp::UserAgent uagent;
+  g_ua_parser.parse(
+      "Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
+      "AppleWebKit/534.46 "
+      "(KHTML, like Gecko) Version/5.1 Mobile/9B206 Safari/7534.48.3",
+      uagent);
+  ASSERT_EQ("Mobile Safari 5.1.0/iOS 5.1.1", uagent.toFullString());
+  ASSERT_EQ("iPhone", uagent.device.family);
+
+  // Fields from the previous result must not leak into the next one
+  const std::string unknown = "unknown client";
+  g_ua_parser.parse(std::string_view(unknown), uagent);
+  ASSERT_EQ("Other", uagent.browser.family);
+  ASSERT_EQ("", uagent.browser.major);
+  ASSERT_EQ("Other", uagent.os.family);
+  ASSERT_EQ("", uagent.os.patch);
+  ASSERT_EQ("Other", uagent.device.family);
+  ASSERT_EQ("", uagent.device.brand);
+  ASSERT_EQ(unknown, uagent.ua_string);
+}
+
+TEST(UserAgentParser, stats) {
+  EXPECT_TRUE(g_ua_parser.stats().browser.rules.empty());
+
+  uap_cpp::ParserOptions options;
+  options.collect_stats = true;
+  const uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml",
+                                        options);
+
+  const std::string iphone =
+      "Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
+      "AppleWebKit/534.46 (KHTML, like Gecko) Version/5.1 Mobile/9B206 "
+      "Safari/7534.48.3";
+  parser.parse(iphone);
+  std::thread([&]() { parser.parse(iphone); }).join();
+  parser.parse_browser("unknown client");
+
+  const auto stats = parser.stats();
+  EXPECT_EQ(stats.device.parses, 2u);
+  EXPECT_EQ(stats.os.parses, 2u);
+  EXPECT_EQ(stats.browser.parses, 3u);
+
+  uint64_t histogram_total = 0;
+  for (auto count : stats.browser.candidates_histogram) {
+    histogram_total += count;
+  }
+  EXPECT_EQ(histogram_total, 3u);
+
+  uint64_t matches = 0;
+  for (const auto& rule : stats.browser.rules) {
+    EXPECT_LE(rule.matches, rule.evaluations);
+    EXPECT_LE(rule.evaluations, rule.candidates);
+    EXPECT_FALSE(rule.regex.empty());
+    if (rule.matches) {
+      EXPECT_GT(rule.match_nanoseconds, 0u);
+    }
+    matches += rule.matches;
+  }
+  EXPECT_EQ(matches, 2u);
+}
+
+TEST(UserAgentParser, no_match_filter) {
+  uap_cpp::ParserOptions options;
+  options.collect_stats = true;
+  options.no_match_filter = true;
+  const uap_cpp::UserAgentParser filtered(UA_CORE_DIR + "/regexes.yaml",
+                                          options);
+  options.no_match_filter = false;
+  const uap_cpp::UserAgentParser unfiltered(UA_CORE_DIR + "/regexes.yaml",
+                                            options);
+
+  for (const std::string ua :
+       {"Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
+        "AppleWebKit/534.46 (KHTML, like Gecko) Version/5.1 Mobile/9B206 "
+        "Safari/7534.48.3",
+        "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:99.0) Gecko/20100101 "
+        "Firefox/99.0",
+        "",
+        "\x01\x02 garbage \xff"}) {
+    const auto expected = unfiltered.parse(ua);
+    const auto actual = filtered.parse(ua);
+    EXPECT_EQ(actual.toFullString(), expected.toFullString());
+    EXPECT_EQ(actual.device.family, expected.device.family);
+  }
+
+  const auto stats = filtered.stats();
+  EXPECT_GT(stats.browser.no_match, 0u);
+  EXPECT_LT(stats.browser.no_match, stats.browser.parses);
+  EXPECT_EQ(unfiltered.stats().browser.no_match, 0u);
+}
+
+TEST(UserAgentParser, memory_usage) {
+  const auto memory = g_ua_parser.memory_usage(3);
+  for (const auto* category : {&memory.device, &memory.os, &memory.browser}) {
+    EXPECT_GT(category->snippet_index_bytes, 0u);
+    EXPECT_GT(category->snippet_mapping_bytes, 0u);
+    EXPECT_GT(category->rules_bytes, 0u);
+    EXPECT_GT(category->regex_bytes, 0u);
+    EXPECT_GT(category->regex_program_size, 0u);
+  }
+  EXPECT_EQ(memory.shared_cache_bytes, 0u);
+  EXPECT_EQ(memory.total(),
+            memory.device.total() + memory.os.total() + memory.browser.total());
+
+  ASSERT_EQ(memory.largest_patterns.size(), 3u);
+  EXPECT_GE(memory.largest_patterns[0].program_size,
+            memory.largest_patterns[1].program_size);
+  EXPECT_GE(memory.largest_patterns[1].program_size,
+            memory.largest_patterns[2].program_size);
+  EXPECT_FALSE(memory.largest_patterns[0].regex.empty());
+  EXPECT_EQ(memory.device.no_match_filter_bytes, 0u);
+  EXPECT_EQ(memory.hot_user_agents_bytes, 0u);
+  EXPECT_EQ(memory.stats_bytes, 0u);
+
+  uap_cpp::ParserOptions options;
+  options.no_match_filter = true;
+  options.hot_user_agents = 64;
+  options.collect_stats = true;
+  const uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml",
+                                        options);
+  parser.parse("curl/7.64.1");
+  const auto more = parser.memory_usage();
+  for (const auto* category : {&more.device, &more.os, &more.browser}) {
+    EXPECT_GT(category->no_match_filter_bytes, 0u);
+  }
+  EXPECT_GT(more.hot_user_agents_bytes, 0u);
+  EXPECT_GT(more.stats_bytes, 0u);
+  EXPECT_EQ(more.total(),
+            more.device.total() + more.os.total() + more.browser.total() +
+                more.hot_user_agents_bytes + more.stats_bytes);
+}
+
+TEST(UserAgentParser, warm_up) {
+  uap_cpp::ParserOptions options;
+  options.collect_stats = true;
+  const uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml",
+                                        options);
+  EXPECT_FALSE(parser.ready());
+
+  auto report = parser.warm_up({}, 2);
+  EXPECT_TRUE(parser.ready());
+  EXPECT_GT(report.user_agents, 50u);
+  EXPECT_EQ(report.threads, 2u);
+  EXPECT_GT(report.nanoseconds, 0u);
+  EXPECT_EQ(parser.stats().browser.parses, report.user_agents);
+
+  // No more threads than user agents
+  report = parser.warm_up({"curl/7.64.1"}, 4);
+  EXPECT_EQ(report.user_agents, 1u);
+  EXPECT_EQ(report.threads, 1u);
+}
+
+TEST(RuleSubset, families) {
+  std::vector<std::string> families;
+  uap_cpp::RuleDefinition rule;
+  rule.regex = "(Googlebot|bingbot)/(\\d+)";
+  EXPECT_TRUE(uap_cpp::RuleSubset::families(rule, families));
+  EXPECT_EQ(families, (std::vector<std::string>{"Googlebot", "bingbot"}));
+
+  rule.replacements[0] = "Spider";
+  EXPECT_TRUE(uap_cpp::RuleSubset::families(rule, families));
+  EXPECT_EQ(families, std::vector<std::string>{"Spider"});
+
+  // Families that depend on the input
+  rule.replacements[0] = "Samsung $1";
+  EXPECT_FALSE(uap_cpp::RuleSubset::families(rule, families));
+  rule.replacements[0].reset();
+  rule.regex = "; *(SM-[A-Z0-9]+)";
+  EXPECT_FALSE(uap_cpp::RuleSubset::families(rule, families));
+  rule.regex = "(?i)(Firefox)/(\\d+)";
+  EXPECT_FALSE(uap_cpp::RuleSubset::families(rule, families));
+
+  EXPECT_EQ(uap_cpp::RuleSubset::withoutCaptures(
+                "(?:Mobile|Tablet);.*(Fire\\(fox\\))/([\\d(]+)"),
+            "(?:Mobile|Tablet);.*(?:Fire\\(fox\\))/(?:[\\d(]+)");
+}
+
+TEST(UserAgentParser, rule_subset) {
+  uap_cpp::ParserOptions options;
+  options.collect_stats = true;
+  options.load_os_rules = false;
+  options.device_families = {"Spider"};
+  options.browser_families = {"Firefox"};
+  uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml", options);
+  uap_cpp::ParserOptions all_options;
+  all_options.collect_stats = true;
+  const auto all =
+      uap_cpp::UserAgentParser(UA_CORE_DIR + "/regexes.yaml", all_options)
+          .stats();
+  const auto stats = parser.stats();
+  EXPECT_EQ(stats.os.rules.size(), 0u);
+  EXPECT_LT(stats.device.rules.size(), all.device.rules.size());
+  EXPECT_LT(stats.browser.rules.size(), all.browser.rules.size());
+
+  std::vector<std::string> corpus(
+      uap_cpp::SAMPLE_USER_AGENTS,
+      uap_cpp::SAMPLE_USER_AGENTS + uap_cpp::SAMPLE_USER_AGENT_COUNT);
+  // Firefox Mobile comes first in regexes.yaml, and must not turn into
+  // Firefox
+  corpus.push_back(
+      "Mozilla/5.0 (Android 12; Mobile; rv:99.0) Gecko/99.0 Firefox/99.0");
+  for (const auto& ua : corpus) {
+    const auto expected = g_ua_parser.parse(ua);
+    const auto actual = parser.parse(ua);
+    EXPECT_EQ(actual.os.family, "Other");
+    if (expected.device.family == "Spider") {
+      EXPECT_EQ(actual.device.family, "Spider") << ua;
+      EXPECT_EQ(actual.device.model, expected.device.model) << ua;
+    } else if (actual.device.family != expected.device.family) {
+      EXPECT_EQ(actual.device.family, "Other") << ua;
+    }
+    if (expected.browser.family == "Firefox") {
+      EXPECT_EQ(actual.browser.toString(), expected.browser.toString()) << ua;
+    } else if (actual.browser.family != expected.browser.family) {
+      EXPECT_EQ(actual.browser.family, "Other") << ua;
+      EXPECT_EQ(actual.browser.major, "") << ua;
+    }
+  }
+  EXPECT_EQ(parser.parse(corpus.back()).browser.family, "Other");
+
+  if (uap_cpp::has_builtin_rules()) {
+    // Re-indexed rather than using the generated indexes of all rules
+    const uap_cpp::UserAgentParser builtin(options);
+    for (const auto& ua : corpus) {
+      EXPECT_EQ(builtin.parse(ua).toFullString(),
+                parser.parse(ua).toFullString());
+    }
+  }
+
+  // Rule definitions are reduced the same way
+  const auto definitions =
+      uap_cpp::RuleDefinitions::load(UA_CORE_DIR + "/regexes.yaml");
+  const uap_cpp::UAStore store(definitions, options);
+  EXPECT_EQ(store.osStore.size(), 0u);
+  EXPECT_EQ(store.browserStore.size(), stats.browser.rules.size());
+  const uap_cpp::UAStore whole(definitions,
+                               uap_cpp::RuleSubset::withAllRules(options));
+  EXPECT_EQ(whole.osStore.size(), all.os.rules.size());
+
+  // but overlays are not
+  uap_cpp::CustomRules rules;
+  rules.os.push_back({"^(Custom OS)/(\\d+)"});
+  parser.set_overlay(rules);
+  const auto custom = parser.parse("Custom OS/3");
+  EXPECT_EQ(custom.os.family, "Custom OS");
+  EXPECT_EQ(custom.os.major, "3");
+}
+
+TEST(UserAgentParser, parse_async) {
+  uap_cpp::ParserOptions options;
+  options.async_threads = 2;
+  options.async_max_batch = 4;
+  const uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml",
+                                        options);
+
+  std::vector<std::string> corpus(
+      uap_cpp::SAMPLE_USER_AGENTS,
+      uap_cpp::SAMPLE_USER_AGENTS + uap_cpp::SAMPLE_USER_AGENT_COUNT);
+  corpus.push_back("unknown client");
+  std::vector<std::future<uap_cpp::UserAgent>> futures;
+  for (const auto& ua : corpus) {
+    futures.push_back(parser.parse_async(ua));
+    ASSERT_TRUE(futures.back().valid());
+  }
+  for (size_t i = 0; i < corpus.size(); ++i) {
+    const auto actual = futures[i].get();
+    const auto expected = g_ua_parser.parse(corpus[i]);
+    EXPECT_EQ(actual.toFullString(), expected.toFullString());
+    EXPECT_EQ(actual.device.family, expected.device.family);
+    EXPECT_EQ(actual.ua_string, corpus[i]);
+  }
+
+  std::promise<std::string> done;
+  EXPECT_TRUE(parser.parse_async(
+      "curl/7.64.1", [&](uap_cpp::UserAgent&& result) {
+        done.set_value(result.browser.family);
+      }));
+  EXPECT_EQ(done.get_future().get(), "curl");
+}
+
+TEST(UserAgentParser, parse_async_queue_full) {
+  std::promise<void> started;
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int> callbacks{0};
+  {
+    uap_cpp::ParserOptions options;
+    options.async_threads = 1;
+    options.async_queue_size = 2;
+    const uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml",
+                                          options);
+
+    // Holds the only worker, so that the next requests stay queued
+    ASSERT_TRUE(parser.parse_async("curl/7.64.1", [&](uap_cpp::UserAgent&&) {
+      started.set_value();
+      released.wait();
+    }));
+    started.get_future().wait();
+
+    auto count = [&](uap_cpp::UserAgent&&) { ++callbacks; };
+    EXPECT_TRUE(parser.parse_async("curl/7.64.1", count));
+    EXPECT_TRUE(parser.parse_async("curl/7.64.1", count));
+    EXPECT_FALSE(parser.parse_async("curl/7.64.1", count));
+    EXPECT_FALSE(parser.parse_async("curl/7.64.1").valid());
+    release.set_value();
+  }
+  // Queued requests were parsed before the parser went away
+  EXPECT_EQ(callbacks.load(), 2);
+}
+
+TEST(UserAgentParser, regex_options) {
+  uap_cpp::ParserOptions options;
+  options.regex_total_memory = 1 << 20;
+  options.literal_fast_path = false;
+  options.no_match_filter = true;
+  options.no_match_filter_memory = 1 << 20;
+  const uap_cpp::UserAgentParser small(UA_CORE_DIR + "/regexes.yaml",
+                                       options);
+
+  for (const std::string ua :
+       {"Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
+        "AppleWebKit/534.46 (KHTML, like Gecko) Version/5.1 Mobile/9B206 "
+        "Safari/7534.48.3",
+        "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:99.0) Gecko/20100101 "
+        "Firefox/99.0",
+        "unknown client"}) {
+    const auto expected = g_ua_parser.parse(ua);
+    const auto actual = small.parse(ua);
+    EXPECT_EQ(actual.toFullString(), expected.toFullString());
+    EXPECT_EQ(actual.device.model, expected.device.model);
+  }
+}
+
+TEST(UserAgentParser, regex_budget_growth) {
+  // Far too small a share for any regex, which grows step by step instead
+  uap_cpp::ParserOptions options;
+  options.regex_total_memory = 1024;
+  options.regex_max_memory = 1 << 20;
+  const uap_cpp::UserAgentParser tiny(UA_CORE_DIR + "/regexes.yaml", options);
+  const auto memory = tiny.memory_usage();
+  EXPECT_GT(memory.device.regexes_over_budget, 0u);
+  EXPECT_GT(memory.os.regexes_over_budget, 0u);
+  EXPECT_GT(memory.browser.regexes_over_budget, 0u);
+  EXPECT_EQ(g_ua_parser.memory_usage().browser.regexes_over_budget, 0u);
+  for (const std::string ua :
+       {"Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:99.0) Gecko/20100101 "
+        "Firefox/99.0",
+        "curl/7.64.1"}) {
+    EXPECT_EQ(tiny.parse(ua).toFullString(),
+              g_ua_parser.parse(ua).toFullString());
+  }
+
+  // Nothing fits in the cap
+  options.regex_max_memory = 64;
+  EXPECT_THROW(
+      uap_cpp::UserAgentParser(UA_CORE_DIR + "/regexes.yaml", options),
+      std::runtime_error);
+}
+
+TEST(UserAgentParser, regex_budget_sharing) {
+  // The same rules with 40 more, whose share of the total budget is smaller
+  const std::string more_rules = testing::TempDir() + "uap_more_rules.yaml";
+  {
+    std::ifstream input(UA_CORE_DIR + "/regexes.yaml");
+    std::string rules((std::istreambuf_iterator<char>(input)),
+                      std::istreambuf_iterator<char>());
+    std::string extra;
+    for (int i = 0; i < 40; ++i) {
+      extra += "  - regex: '(Extra" + std::to_string(i) + ")/(\\d+)'\n";
+    }
+    const std::string section = "user_agent_parsers:\n";
+    ASSERT_EQ(rules.compare(0, section.size(), section), 0);
+    rules.insert(section.size(), extra);
+    std::ofstream(more_rules) << rules;
+  }
+
+  uap_cpp::ParserOptions options;
+  options.regex_total_memory = 1 << 20;
+  const uap_cpp::UserAgentParser fewer(UA_CORE_DIR + "/regexes.yaml",
+                                       options);
+  const size_t before = uap_cpp::Pattern::compiledCount();
+  const uap_cpp::UserAgentParser more(more_rules, options);
+  EXPECT_EQ(uap_cpp::Pattern::compiledCount(), before + 40);
+  EXPECT_EQ(more.parse("Extra7/3").browser.family, "Extra7");
+
+  std::remove(more_rules.c_str());
+}
+
+TEST(UserAgentParser, explain) {
+  const std::string ua =
+      "Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
+      "AppleWebKit/534.46 (KHTML, like Gecko) Version/5.1 Mobile/9B206 "
+      "Safari/7534.48.3";
+  const auto explanation = g_ua_parser.explain(ua);
+  const auto expected = g_ua_parser.parse(ua);
+
+  EXPECT_EQ(explanation.result.browser.family, expected.browser.family);
+  EXPECT_EQ(explanation.result.browser.major, expected.browser.major);
+  EXPECT_EQ(explanation.result.os.family, expected.os.family);
+  EXPECT_EQ(explanation.result.device.model, expected.device.model);
+
+  // Snippets are indexed in lowercase
+  std::string lowercase_ua = ua;
+  for (auto& c : lowercase_ua) {
+    c = tolower(c);
+  }
+
+  for (const auto* category :
+       {&explanation.device, &explanation.os, &explanation.browser}) {
+    ASSERT_GE(category->winner, 0);
+    const auto& candidates = category->candidates;
+    ASSERT_LT(static_cast<size_t>(category->winner), candidates.size());
+    for (int i = 0; i < category->winner; ++i) {
+      EXPECT_TRUE(candidates[i].evaluated);
+      EXPECT_FALSE(candidates[i].matched);
+    }
+    EXPECT_TRUE(candidates[category->winner].matched);
+    for (size_t i = category->winner + 1; i < candidates.size(); ++i) {
+      EXPECT_FALSE(candidates[i].evaluated);
+      EXPECT_LT(candidates[i - 1].index, candidates[i].index);
+    }
+    EXPECT_FALSE(category->snippets.empty());
+    for (const auto& snippet : category->snippets) {
+      EXPECT_NE(lowercase_ua.find(snippet.text), std::string::npos);
+    }
+  }
+
+  const auto unknown = g_ua_parser.explain("unknown client");
+  EXPECT_EQ(unknown.browser.winner, -1);
+  EXPECT_EQ(unknown.result.browser.family, "Other");
+}
+
+namespace {
+
+struct CountingStageHook : uap_cpp::StageHook {
+  void on_stage(uap_cpp::Category category,
+                uap_cpp::Stage stage,
+                uint64_t) noexcept override {
+    ++calls[static_cast<int>(category)][static_cast<int>(stage)];
+  }
+  std::atomic<int> calls[3][4]{};
+};
+
+}  // namespace
+
+TEST(UserAgentParser, stage_hooks) {
+  CountingStageHook hook;
+  uap_cpp::ParserOptions options;
+  options.stage_hook = &hook;
+  const uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml",
+                                        options);
+
+  parser.parse("Mozilla/5.0 (Windows NT 10.0) Firefox/99.0");
+  parser.parse_browser("unknown client");
+
+  const int hooked = uap_cpp::stage_hooks_enabled() ? 1 : 0;
+  EXPECT_EQ(hook.calls[0][0], hooked);
+  EXPECT_EQ(hook.calls[2][0], 2 * hooked);
+  EXPECT_EQ(hook.calls[2][1], 2 * hooked);
+  EXPECT_EQ(hook.calls[2][2], 2 * hooked);
+  // The unknown client has no winning rule, so nothing to replace
+  EXPECT_EQ(hook.calls[2][3], hooked);
+}
+
+TEST(UserAgentParser, limits) {
+  const std::string ua =
+      "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, "
+      "like Gecko) Chrome/99.0.4844.51 Safari/537.36";
+
+  auto unlimited = g_ua_parser.parse(ua);
+  EXPECT_FALSE(unlimited.limits_hit.any());
+
+  uap_cpp::ParserOptions options;
+  options.max_length = 40;
+  const uap_cpp::UserAgentParser truncating(UA_CORE_DIR + "/regexes.yaml",
+                                            options);
+  auto truncated = truncating.parse(ua);
+  EXPECT_TRUE(truncated.limits_hit.length);
+  EXPECT_FALSE(truncated.limits_hit.candidates);
+  EXPECT_EQ(truncated.ua_string, ua);
+  EXPECT_EQ(truncated.os.family, "Windows");
+  EXPECT_EQ(truncated.browser.family, "Other");
+  EXPECT_FALSE(truncating.parse("Mozilla/5.0").limits_hit.any());
+
+  // Cap the browser candidates just below the winning rule
+  const std::string android =
+      "Mozilla/5.0 (Linux; Android 12; Pixel 6) AppleWebKit/537.36 (KHTML, "
+      "like Gecko) Chrome/99.0.4844.58 Mobile Safari/537.36";
+  const auto explanation = g_ua_parser.explain(android);
+  ASSERT_GT(explanation.browser.winner, 0);
+  options = uap_cpp::ParserOptions();
+  options.max_candidates = explanation.browser.winner;
+  const uap_cpp::UserAgentParser capped(UA_CORE_DIR + "/regexes.yaml",
+                                        options);
+  auto capped_result = capped.parse(android);
+  EXPECT_TRUE(capped_result.limits_hit.candidates);
+  EXPECT_EQ(capped_result.browser.family, "Other");
+
+  options = uap_cpp::ParserOptions();
+  options.time_budget_nanoseconds = 1;
+  const uap_cpp::UserAgentParser timed(UA_CORE_DIR + "/regexes.yaml",
+                                       options);
+  const std::string junk(64 * 1024, 'a');
+  auto timed_out = timed.parse(junk + ua);
+  EXPECT_TRUE(timed_out.limits_hit.time);
+  EXPECT_EQ(timed_out.browser.family, "Other");
+}
+
+TEST(UserAgentParser, builtin_rules) {
+  if (!uap_cpp::has_builtin_rules()) {
+    EXPECT_THROW(uap_cpp::UserAgentParser(), std::runtime_error);
+    return;
+  }
+
+  // The tests are expected to use the same regexes.yaml as the build
+  const uap_cpp::UserAgentParser builtin;
+  for (const std::string ua :
+       {"Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
+        "AppleWebKit/534.46 (KHTML, like Gecko) Version/5.1 Mobile/9B206 "
+        "Safari/7534.48.3",
+        "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:99.0) Gecko/20100101 "
+        "Firefox/99.0",
+        "unknown client"}) {
+    const auto expected = g_ua_parser.parse(ua);
+    const auto actual = builtin.parse(ua);
+    EXPECT_EQ(actual.toFullString(), expected.toFullString());
+    EXPECT_EQ(actual.device.family, expected.device.family);
+    EXPECT_EQ(actual.device.brand, expected.device.brand);
+    EXPECT_EQ(actual.device.model, expected.device.model);
+  }
+
+  const auto explanation =
+      builtin.explain("Mozilla/5.0 (Windows NT 10.0) Firefox/99.0");
+  EXPECT_FALSE(explanation.browser.snippets.empty());
+  EXPECT_FALSE(explanation.browser.snippets[0].text.empty());
+}
+
+#ifndef _WIN32
+TEST(UserAgentParser, shared_cache) {
+  const std::string path = testing::TempDir() + "uap_shared_cache_test";
+  std::remove(path.c_str());
+
+  uap_cpp::ParserOptions options;
+  options.collect_stats = true;
+  options.shared_cache_path = path;
+  options.shared_cache_entries = 64;
+  const std::string ua =
+      "Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
+      "AppleWebKit/534.46 (KHTML, like Gecko) Version/5.1 Mobile/9B206 "
+      "Safari/7534.48.3";
+  {
+    const uap_cpp::UserAgentParser writer(UA_CORE_DIR + "/regexes.yaml",
+                                          options);
+    writer.parse(ua);
+    EXPECT_EQ(writer.stats().shared_cache_misses, 1u);
+  }
+
+  // Another parser, as another process would, finds the result in the file
+  const uap_cpp::UserAgentParser reader(UA_CORE_DIR + "/regexes.yaml",
+                                        options);
+  const auto expected = g_ua_parser.parse(ua);
+  const auto cached = reader.parse(ua);
+  EXPECT_EQ(reader.stats().shared_cache_hits, 1u);
+  EXPECT_EQ(cached.ua_string, ua);
+  EXPECT_EQ(cached.toFullString(), expected.toFullString());
+  EXPECT_EQ(cached.device.brand, expected.device.brand);
+  EXPECT_EQ(cached.device.model, expected.device.model);
+  EXPECT_EQ(cached.browser.patch_minor, expected.browser.patch_minor);
+
+  reader.parse("unknown client");
+  EXPECT_EQ(reader.stats().shared_cache_misses, 1u);
+  std::remove(path.c_str());
+
+  // Parsers that differ only in options that change results do not share
+  // results
+  const std::string rules_path = testing::TempDir() + "uap_longest_rules.yaml";
+  {
+    std::ofstream rules(rules_path);
+    rules << "user_agent_parsers:\n"
+             "  - regex: '(Foo|FooBar)'\n"
+             "os_parsers: []\n"
+             "device_parsers: []\n";
+  }
+  options.longest_match = false;
+  const uap_cpp::UserAgentParser first(rules_path, options);
+  EXPECT_EQ(first.parse("FooBar/1").browser.family, "Foo");
+  options.longest_match = true;
+  const uap_cpp::UserAgentParser longest(rules_path, options);
+  EXPECT_EQ(longest.parse("FooBar/1").browser.family, "FooBar");
+  EXPECT_EQ(longest.stats().shared_cache_hits, 0u);
+
+  std::remove(path.c_str());
+  std::remove(rules_path.c_str());
+}
+#endif
+
+TEST(UserAgentParser, warm_cache) {
+  const std::string path = testing::TempDir() + "uap_warm_cache_test";
+  const std::string other_rules = testing::TempDir() + "uap_other_rules.yaml";
+  std::remove(path.c_str());
+
+  const std::string hot = "Mozilla/5.0 (Windows NT 10.0) Firefox/99.0";
+  const std::string cold = "Mozilla/5.0 (Windows NT 6.1) Firefox/3.6";
+  {
+    uap_cpp::ParserOptions options;
+    options.warm_cache_path = path;
+    options.hot_user_agents = 16;
+    const uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml",
+                                          options);
+    EXPECT_THROW(g_ua_parser.save_warm_cache(path), std::runtime_error);
+
+    for (int i = 0; i < 3; ++i) {
+      parser.parse(hot);
+    }
+    parser.parse(cold);
+    EXPECT_EQ(parser.save_warm_cache(path, 1), 1u);
+  }
+
+  uap_cpp::ParserOptions options;
+  options.collect_stats = true;
+  options.warm_cache_path = path;
+  const uap_cpp::UserAgentParser warm(UA_CORE_DIR + "/regexes.yaml", options);
+  const auto expected = g_ua_parser.parse(hot);
+  const auto cached = warm.parse(hot);
+  EXPECT_EQ(cached.toFullString(), expected.toFullString());
+  EXPECT_EQ(cached.ua_string, hot);
+  EXPECT_EQ(warm.parse(cold).toFullString(),
+            g_ua_parser.parse(cold).toFullString());
+  EXPECT_EQ(warm.stats().warm_cache_hits, 1u);
+  EXPECT_EQ(warm.stats().warm_cache_misses, 1u);
+
+  // Offsets of a damaged file are not followed out of the file
+  const std::string damaged = testing::TempDir() + "uap_warm_cache_damaged";
+  {
+    std::ifstream input(path, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(input)),
+                         std::istreambuf_iterator<char>());
+    // Bucket offsets follow the 40-byte header
+    uint64_t bucket_count;
+    memcpy(&bucket_count, contents.data() + 24, sizeof(bucket_count));
+    ASSERT_LT(40 + (bucket_count + 1) * 8, contents.size());
+    for (uint64_t i = 0; i <= bucket_count; ++i) {
+      const uint64_t offset = ~uint64_t(0) - 4;
+      memcpy(&contents[40 + i * 8], &offset, sizeof(offset));
+    }
+    std::ofstream(damaged, std::ios::binary) << contents;
+  }
+  options.warm_cache_path = damaged;
+  const uap_cpp::UserAgentParser broken(UA_CORE_DIR + "/regexes.yaml",
+                                        options);
+  EXPECT_EQ(broken.parse(hot).toFullString(), expected.toFullString());
+  std::remove(damaged.c_str());
+  options.warm_cache_path = path;
+
+  // Results saved with other rules are ignored
+  {
+    std::ofstream rules(other_rules);
+    rules << "user_agent_parsers:\n"
+             "  - regex: 'Firefox/(\\d+)'\n"
+             "    family_replacement: 'Other rules'\n"
+             "os_parsers: []\n"
+             "device_parsers: []\n";
+  }
+  const uap_cpp::UserAgentParser other(other_rules, options);
+  EXPECT_EQ(other.parse(hot).browser.family, "Other rules");
+  EXPECT_EQ(other.stats().warm_cache_hits, 0u);
+
+  // and so are results saved before a rule moved to another category
+  {
+    std::ofstream rules(other_rules);
+    rules << "user_agent_parsers:\n"
+             "  - regex: 'Chrome/(\\d+)'\n"
+             "  - regex: '(Firefox)/(\\d+)'\n"
+             "os_parsers:\n"
+             "  - regex: '(Windows NT)'\n"
+             "device_parsers: []\n";
+  }
+  {
+    uap_cpp::ParserOptions save_options;
+    save_options.hot_user_agents = 16;
+    const uap_cpp::UserAgentParser parser(other_rules, save_options);
+    EXPECT_EQ(parser.parse(hot).browser.family, "Firefox");
+    EXPECT_EQ(parser.save_warm_cache(path), 1u);
+  }
+  {
+    std::ofstream rules(other_rules);
+    rules << "user_agent_parsers:\n"
+             "  - regex: 'Chrome/(\\d+)'\n"
+             "os_parsers:\n"
+             "  - regex: '(Firefox)/(\\d+)'\n"
+             "  - regex: '(Windows NT)'\n"
+             "device_parsers: []\n";
+  }
+  const uap_cpp::UserAgentParser moved(other_rules, options);
+  EXPECT_EQ(moved.parse(hot).browser.family, "Other");
+  EXPECT_EQ(moved.parse(hot).os.family, "Firefox");
+  EXPECT_EQ(moved.stats().warm_cache_hits, 0u);
+
+  std::remove(path.c_str());
+  std::remove(other_rules.c_str());
+}
+
+TEST(UserAgentParser, overlay) {
+  const std::string ua =
+      "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:99.0) Gecko/20100101 "
+      "Firefox/99.0";
+  uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml");
+  const auto base = parser.parse(ua);
+  ASSERT_EQ(base.browser.family, "Firefox");
+
+  uap_cpp::CustomRules rules;
+  uap_cpp::CustomRule custom;
+  custom.regex = "Firefox/(\\d+)";
+  custom.family = "Custom";
+  custom.major = "$1";
+  rules.browser.push_back(custom);
+  rules.device.push_back({"NoSuchDevice", false, "Never"});
+  parser.set_overlay(rules);
+  auto result = parser.parse(ua);
+  EXPECT_EQ(result.browser.family, "Custom");
+  EXPECT_EQ(result.browser.major, "99");
+  EXPECT_EQ(result.browser.minor, "");
+  // Categories the overlay does not match fall back to the parser rules
+  EXPECT_EQ(result.os.toString(), base.os.toString());
+  EXPECT_EQ(result.device.family, base.device.family);
+  EXPECT_EQ(parser.parse_browser(ua).family, "Custom");
+
+  // After the parser rules, the overlay only fills unmatched categories
+  rules.browser.push_back({"^(Unknown)/(\\d+)", false, "Fallback"});
+  parser.set_overlay(rules, uap_cpp::OverlayPosition::kAfter);
+  EXPECT_EQ(parser.parse(ua).browser.family, "Firefox");
+  EXPECT_EQ(parser.parse("Unknown/7").browser.family, "Fallback");
+  EXPECT_EQ(parser.parse("Unknown/7").browser.major, "7");
+
+  parser.clear_overlay();
+  EXPECT_EQ(parser.parse(ua).toFullString(), base.toFullString());
+  EXPECT_EQ(parser.parse("Unknown/7").browser.family, "Other");
+
+  const std::string overlay_rules =
+      testing::TempDir() + "uap_overlay_rules.yaml";
+  {
+    std::ofstream file(overlay_rules);
+    file << "user_agent_parsers: []\n"
+            "os_parsers:\n"
+            "  - regex: 'Windows NT 10'\n"
+            "    os_replacement: 'Overlay OS'\n"
+            "device_parsers: []\n";
+  }
+  parser.set_overlay(overlay_rules);
+  EXPECT_EQ(parser.parse(ua).os.family, "Overlay OS");
+  EXPECT_EQ(parser.parse(ua).browser.family, "Firefox");
+  EXPECT_THROW(parser.set_overlay(overlay_rules + ".missing"), std::exception);
+  EXPECT_EQ(parser.parse(ua).os.family, "Overlay OS");
+  std::remove(overlay_rules.c_str());
+}
+
+TEST(UserAgentParser, client_hints) {
+  const std::string ua =
+      "Mozilla/5.0 (Linux; Android 10; K) AppleWebKit/537.36 (KHTML, like "
+      "Gecko) Chrome/124.0.0.0 Mobile Safari/537.36";
+  uap_cpp::ClientHints hints;
+  hints.brands =
+      R"("Chromium";v="124", "Google Chrome";v="124", "Not-A.Brand";v="99")";
+  hints.full_version_list =
+      R"("Chromium";v="124.0.6367.82", "Google Chrome";v="124.0.6367.82")";
+  hints.platform = R"("Android")";
+  hints.platform_version = R"("14.0.0")";
+  hints.model = R"("Pixel 7")";
+  hints.mobile = "?1";
+
+  auto result = g_ua_parser.parse(ua, hints);
+  EXPECT_EQ(result.browser.family, "Chrome Mobile");
+  EXPECT_EQ(result.browser.toVersionString(), "124.0.6367");
+  EXPECT_EQ(result.browser.patch_minor, "82");
+  EXPECT_EQ(result.os.family, "Android");
+  EXPECT_EQ(result.os.major, "14");
+  EXPECT_EQ(result.device.family, "Pixel 7");
+  EXPECT_EQ(result.device.brand, "Generic_Android");
+  EXPECT_EQ(result.device.model, "Pixel 7");
+  EXPECT_EQ(result.ua_string, ua);
+
+  // The device rules read the model
+  hints.model = R"("SM-S918B")";
+  result = g_ua_parser.parse(ua, hints);
+  EXPECT_EQ(result.device.family, "Samsung SM-S918B");
+  EXPECT_EQ(result.device.brand, "Samsung");
+  EXPECT_EQ(result.device.model, "SM-S918B");
+
+  // Without the high-entropy hints, the rules fill the OS and device
+  const auto from_ua = g_ua_parser.parse(ua);
+  hints.full_version_list = {};
+  hints.platform_version = {};
+  hints.model = {};
+  result = g_ua_parser.parse(ua, hints);
+  EXPECT_EQ(result.browser.family, "Chrome Mobile");
+  EXPECT_EQ(result.browser.major, "124");
+  EXPECT_EQ(result.browser.minor, "");
+  EXPECT_EQ(result.os.toString(), from_ua.os.toString());
+  EXPECT_EQ(result.device.family, from_ua.device.family);
+
+  // Unknown brands and platforms are left to the rules, and so is a model
+  // on another platform than Android
+  hints.brands = R"("Chromium";v="124", "Other Browser";v="3")";
+  hints.platform = R"("Unknown")";
+  hints.model = R"("Pixel 7")";
+  result = g_ua_parser.parse(ua, hints);
+  EXPECT_EQ(result.toFullString(), from_ua.toFullString());
+  EXPECT_EQ(result.device.model, from_ua.device.model);
+
+  hints = uap_cpp::ClientHints();
+  hints.brands = R"("Microsoft Edge";v="124", "Chromium";v="124")";
+  hints.platform = R"("Windows")";
+  hints.platform_version = R"("15.0.0")";
+  result = g_ua_parser.parse(ua, hints);
+  EXPECT_EQ(result.browser.family, "Edge");
+  EXPECT_EQ(result.os.toString(), "Windows 11.0.0");
+}
+
+TEST(ClientHintsParser, structured_fields) {
+  std::string_view value;
+  EXPECT_TRUE(uap_cpp::ClientHintsParser::parseString(" \"macOS\" ", value));
+  EXPECT_EQ(value, "macOS");
+  EXPECT_FALSE(uap_cpp::ClientHintsParser::parseString("macOS", value));
+  EXPECT_FALSE(uap_cpp::ClientHintsParser::parseString("\"mac", value));
+  EXPECT_FALSE(uap_cpp::ClientHintsParser::parseString(R"("a\"b")", value));
+
+  bool mobile = false;
+  EXPECT_TRUE(uap_cpp::ClientHintsParser::parseBoolean("?1", mobile));
+  EXPECT_TRUE(mobile);
+  EXPECT_FALSE(uap_cpp::ClientHintsParser::parseBoolean("1", mobile));
+
+  std::string_view list =
+      R"("Not A(Brand";v="8", "Chromium"; v="132";x=1 ,"Brave";v="132")";
+  std::string_view brand, version;
+  ASSERT_TRUE(uap_cpp::ClientHintsParser::nextBrand(list, brand, version));
+  EXPECT_EQ(brand, "Not A(Brand");
+  EXPECT_EQ(version, "8");
+  ASSERT_TRUE(uap_cpp::ClientHintsParser::nextBrand(list, brand, version));
+  EXPECT_EQ(brand, "Chromium");
+  EXPECT_EQ(version, "132");
+  ASSERT_TRUE(uap_cpp::ClientHintsParser::nextBrand(list, brand, version));
+  EXPECT_EQ(brand, "Brave");
+  EXPECT_FALSE(uap_cpp::ClientHintsParser::nextBrand(list, brand, version));
+  EXPECT_TRUE(list.empty());
+
+  list = R"("Chromium";v="124",)";
+  EXPECT_FALSE(uap_cpp::ClientHintsParser::nextBrand(list, brand, version));
+  EXPECT_FALSE(list.empty());
+}
+
+TEST(ServerProtocol, round_trip) {
+  std::string data;
+  uap_cpp::ServerProtocol::appendRequest(7, "curl/7.64.1", data);
+  const auto expected = g_ua_parser.parse(
+      "Mozilla/5.0 (iPhone; CPU iPhone OS 12_4 like Mac OS X) "
+      "AppleWebKit/605.1.15 (KHTML, like Gecko) Version/12.1.2 Mobile/15E148 "
+      "Safari/604.1");
+  uap_cpp::ServerProtocol::appendResponse(8, expected, data);
+
+  std::string_view buffer = data;
+  std::string_view payload;
+  ASSERT_TRUE(uap_cpp::ServerProtocol::nextFrame(buffer, payload));
+  uint32_t id;
+  std::string_view ua;
+  ASSERT_TRUE(uap_cpp::ServerProtocol::decodeRequest(payload, id, ua));
+  EXPECT_EQ(id, 7u);
+  EXPECT_EQ(ua, "curl/7.64.1");
+
+  // A partial frame waits for the rest
+  std::string_view partial = buffer.substr(0, buffer.size() - 1);
+  EXPECT_FALSE(uap_cpp::ServerProtocol::nextFrame(partial, payload));
+
+  ASSERT_TRUE(uap_cpp::ServerProtocol::nextFrame(buffer, payload));
+  EXPECT_TRUE(buffer.empty());
+  uap_cpp::UserAgent result;
+  ASSERT_TRUE(uap_cpp::ServerProtocol::decodeResponse(payload, id, result));
+  EXPECT_EQ(id, 8u);
+  EXPECT_EQ(result.toFullString(), expected.toFullString());
+  EXPECT_EQ(result.device.model, expected.device.model);
+  EXPECT_EQ(result.browser.patch_minor, expected.browser.patch_minor);
+  EXPECT_FALSE(uap_cpp::ServerProtocol::decodeResponse(
+      payload.substr(0, payload.size() - 1), id, result));
+
+  std::string huge(4, '\xff');
+  buffer = huge;
+  EXPECT_THROW(uap_cpp::ServerProtocol::nextFrame(buffer, payload),
+               std::runtime_error);
+}
+
+#ifndef _WIN32
+TEST(ParserServer, serves_clients) {
+  const std::string path = testing::TempDir() + "uap_server_test.sock";
+  uap_cpp::ParserServer server(g_ua_parser, path, 2, 4);
+  std::thread runner([&] { server.run(); });
+
+  std::vector<std::string> corpus(
+      uap_cpp::SAMPLE_USER_AGENTS,
+      uap_cpp::SAMPLE_USER_AGENTS + uap_cpp::SAMPLE_USER_AGENT_COUNT);
+  corpus.push_back("unknown client");
+  const std::vector<std::string_view> user_agents(corpus.begin(),
+                                                  corpus.end());
+
+  std::vector<std::thread> clients;
+  std::atomic<int> mismatches{0};
+  for (int c = 0; c < 3; ++c) {
+    clients.emplace_back([&] {
+      uap_cpp::ParserClient client(path, 16);
+      std::vector<uap_cpp::UserAgent> results;
+      for (int round = 0; round < 3; ++round) {
+        client.parse(user_agents, results);
+        for (size_t i = 0; i < corpus.size(); ++i) {
+          const auto expected = g_ua_parser.parse(corpus[i]);
+          if (results[i].toFullString() != expected.toFullString() ||
+              results[i].device.family != expected.device.family ||
+              results[i].ua_string != corpus[i]) {
+            ++mismatches;
+          }
+        }
+      }
+      if (client.parse("curl/7.64.1").ua_string != "curl/7.64.1") {
+        ++mismatches;
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  EXPECT_EQ(mismatches.load(), 0);
+  EXPECT_EQ(server.parsed(), 3 * (3 * corpus.size() + 1));
+
+  // An open connection does not keep the server from stopping
+  uap_cpp::ParserClient idle(path);
+  server.stop();
+  runner.join();
+  EXPECT_THROW(idle.parse("curl/7.64.1"), std::exception);
+}
+
+TEST(ParserServer, large_window) {
+  const std::string path = testing::TempDir() + "uap_server_window.sock";
+  uap_cpp::ParserServer server(g_ua_parser, path, 2);
+  std::thread runner([&] { server.run(); });
+
+  // Far more requests and responses than the socket buffers hold
+  const std::string ua = "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:99.0) "
+                         "Gecko/20100101 Firefox/99.0 " +
+                         std::string(256, 'x');
+  const std::vector<std::string_view> user_agents(20000, ua);
+  uap_cpp::ParserClient client(path, user_agents.size());
+  std::vector<uap_cpp::UserAgent> results;
+  client.parse(user_agents, results);
+  ASSERT_EQ(results.size(), user_agents.size());
+  EXPECT_EQ(results.back().browser.family, "Firefox");
+  EXPECT_EQ(results.back().ua_string, ua);
+
+  server.stop();
+  runner.join();
+}
+
+TEST(ParserServer, connection_limit) {
+  const std::string path = testing::TempDir() + "uap_server_limit.sock";
+  uap_cpp::ParserServer server(g_ua_parser, path, 1, 4, 1);
+  std::thread runner([&] { server.run(); });
+
+  std::unique_ptr<uap_cpp::ParserClient> first(
+      new uap_cpp::ParserClient(path));
+  EXPECT_EQ(first->parse("curl/7.64.1").ua_string, "curl/7.64.1");
+
+  // The second client waits until the first one disconnects
+  std::atomic<bool> served{false};
+  std::thread second([&] {
+    uap_cpp::ParserClient client(path);
+    EXPECT_EQ(client.parse("curl/7.64.1").browser.family, "curl");
+    served = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_FALSE(served.load());
+  first.reset();
+  second.join();
+  EXPECT_TRUE(served.load());
+
+  server.stop();
+  runner.join();
+}
+
+TEST(UserAgentParser, overlay_cached_results) {
+  const std::string path = testing::TempDir() + "uap_overlay_cache_test";
+  std::remove(path.c_str());
+
+  uap_cpp::ParserOptions options;
+  options.shared_cache_path = path;
+  options.shared_cache_entries = 64;
+  uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml", options);
+  const std::string ua = "Mozilla/5.0 (Windows NT 10.0) Firefox/99.0";
+  EXPECT_EQ(parser.parse(ua).browser.family, "Firefox");
+
+  // Results cached without the overlay are not returned with it
+  uap_cpp::CustomRules rules;
+  rules.browser.push_back({"Firefox", false, "Custom"});
+  parser.set_overlay(rules);
+  EXPECT_EQ(parser.parse(ua).browser.family, "Custom");
+  parser.clear_overlay();
+  EXPECT_EQ(parser.parse(ua).browser.family, "Firefox");
+
+  std::remove(path.c_str());
+}
+#endif
+
 TEST(UserAgentParser, DeviceTypeMobile) {
   EXPECT_TRUE(uap_cpp::UserAgentParser::device_type(
                   "Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
@@ -343,6 +1366,288 @@ TEST(ReplaceTemplate, expansions) {
             "ming");
   EXPECT_EQ(match_and_expand("([^ ]+) (.+)", "a b", "$2-$1"), "b-a");
 }
+
+TEST(Pattern, shared_compilation) {
+  const std::string regex = "PatternPoolTest/(\\d+)";
+  const size_t before = uap_cpp::Pattern::compiledCount();
+  {
+    const uap_cpp::Pattern a(regex);
+    const uap_cpp::Pattern b(regex);
+    EXPECT_EQ(uap_cpp::Pattern::compiledCount(), before + 1);
+
+    // Case sensitivity is part of the compiled expression
+    const uap_cpp::Pattern c(regex, false);
+    EXPECT_EQ(uap_cpp::Pattern::compiledCount(), before + 2);
+
+    uap_cpp::Match m;
+    EXPECT_TRUE(b.match("PatternPoolTest/12", m));
+    EXPECT_EQ(m.get(1), "12");
+    EXPECT_FALSE(b.match("patternpooltest/12", m));
+    EXPECT_TRUE(c.match("patternpooltest/12", m));
+  }
+  EXPECT_EQ(uap_cpp::Pattern::compiledCount(), before);
+
+  // Parsers loaded with the same rules share all their expressions
+  const size_t loaded = uap_cpp::Pattern::compiledCount();
+  const uap_cpp::UserAgentParser parser(UA_CORE_DIR + "/regexes.yaml");
+  EXPECT_EQ(uap_cpp::Pattern::compiledCount(), loaded);
+}
+
+TEST(Pattern, options) {
+  uap_cpp::PatternOptions regex_only;
+  regex_only.literalFastPath = false;
+  const uap_cpp::Pattern literal("Googlebot");
+  const uap_cpp::Pattern regex("Googlebot", true, regex_only);
+
+  uap_cpp::Match m1;
+  uap_cpp::Match m2;
+  EXPECT_TRUE(literal.match("Mozilla/5.0 (compatible; Googlebot/2.1)", m1));
+  EXPECT_TRUE(regex.match("Mozilla/5.0 (compatible; Googlebot/2.1)", m2));
+  EXPECT_EQ(m1.size(), m2.size());
+  EXPECT_EQ(m1.get(0), m2.get(0));
+  EXPECT_FALSE(literal.match("googlebot", m1));
+
+  // A budget too small for the program falls back to the default budget
+  uap_cpp::PatternOptions tiny;
+  tiny.maxMemory = 1;
+  const uap_cpp::Pattern fallback("(\\w+)/(\\d+)\\.(\\d+)", true, tiny);
+  EXPECT_TRUE(fallback.match("Firefox/99.0", m1));
+  EXPECT_EQ(m1.get(1), "Firefox");
+}
+
+TEST(ResultWriter, json) {
+  uap_cpp::UserAgent uagent;
+  uagent.browser.family = "Mobile Safari";
+  uagent.browser.major = "5";
+  uagent.browser.minor = "1";
+  uagent.os.family = "iOS";
+  uagent.os.major = "5";
+  uagent.device.family = "iPhone";
+  uagent.device.brand = "Apple";
+  uagent.ua_string = "a \"quoted\"\\path\t\x01";
+
+  std::string out = "prefix ";
+  uap_cpp::append_json(uagent, out);
+  EXPECT_EQ(out,
+            "prefix {\"user_agent\":{\"family\":\"Mobile Safari\",\"major\":"
+            "\"5\",\"minor\":\"1\",\"patch\":null},\"os\":{\"family\":\"iOS\","
+            "\"major\":\"5\",\"minor\":null,\"patch\":null,\"patch_minor\":null},"
+            "\"device\":{\"family\":\"iPhone\",\"brand\":\"Apple\",\"model\":"
+            "null},\"string\":\"a \\\"quoted\\\"\\\\path\\t\\u0001\"}");
+}
+
+TEST(ResultWriter, tsv) {
+  uap_cpp::UserAgent uagent;
+  uagent.browser.family = "Fire\tfox";
+  uagent.browser.major = "68";
+  uagent.device.model = "back\\slash\n";
+
+  const std::vector<uap_cpp::Field> columns{uap_cpp::Field::kBrowserFamily,
+                                            uap_cpp::Field::kBrowserMajor,
+                                            uap_cpp::Field::kBrowserMinor,
+                                            uap_cpp::Field::kDeviceModel};
+  std::string out;
+  uap_cpp::append_tsv_header(columns, out);
+  EXPECT_EQ(out, "browser_family\tbrowser_major\tbrowser_minor\tdevice_model");
+
+  out.clear();
+  uap_cpp::append_tsv(uagent, columns, out);
+  EXPECT_EQ(out, "Fire\\tfox\t68\t\tback\\\\slash\\n");
+
+  out.clear();
+  uap_cpp::append_tsv(uagent, uap_cpp::default_columns(), out);
+  EXPECT_EQ(out,
+            "Fire\\tfox\t68\t\t\tOther\t\t\t\tOther\t\tback\\\\slash\\n");
+}
+
+TEST(LogEnricher, find_user_agent) {
+  const std::string line =
+      "127.0.0.1 - frank [10/Oct/2000:13:55:36 -0700] \"GET /a.gif HTTP/1.0\" "
+      "200 2326 \"http://example.com/?q=\\\"x\\\"\" \"Mozilla/4.08 [en] "
+      "(Win98; I ;Nav)\" \"-\"";
+  EXPECT_EQ(uap_cpp::find_log_user_agent(line),
+            "Mozilla/4.08 [en] (Win98; I ;Nav)");
+  EXPECT_EQ(uap_cpp::find_log_user_agent(line, 0), "GET /a.gif HTTP/1.0");
+  EXPECT_EQ(uap_cpp::find_log_user_agent(line, 1),
+            "http://example.com/?q=\\\"x\\\"");
+  EXPECT_EQ(uap_cpp::find_log_user_agent(line, 3), "-");
+  EXPECT_EQ(uap_cpp::find_log_user_agent(line, 4), "");
+  EXPECT_EQ(uap_cpp::find_log_user_agent("no \"closing quote"), "");
+}
+
+TEST(LogEnricher, enrich_log) {
+  const std::string log =
+      "::1 - - [01/Jan/2020:00:00:00 +0000] \"GET / HTTP/1.1\" 200 1 \"-\" "
+      "\"Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
+      "AppleWebKit/534.46 (KHTML, like Gecko) Version/5.1 Mobile/9B206 "
+      "Safari/7534.48.3\"\n"
+      "malformed line\r\n";
+
+  uap_cpp::LogEnrichOptions options;
+  options.columns = {uap_cpp::Field::kBrowserFamily,
+                     uap_cpp::Field::kOsFamily,
+                     uap_cpp::Field::kDeviceFamily};
+  options.threads = 2;
+
+  std::string out;
+  uap_cpp::enrich_log(
+      g_ua_parser, log, [&](std::string_view s) { out += s; }, options);
+
+  const std::string expected =
+      log.substr(0, log.find('\n')) +
+      "\tMobile Safari\tiOS\tiPhone\n"
+      "malformed line\tOther\tOther\tOther\n";
+  EXPECT_EQ(out, expected);
+
+  std::istringstream stream(log);
+  out.clear();
+  uap_cpp::enrich_log(
+      g_ua_parser, stream, [&](std::string_view s) { out += s; }, options);
+  EXPECT_EQ(out, expected);
+}
+
+TEST(Aggregator, counts_by_key_fields) {
+  const std::string iphone =
+      "Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) "
+      "AppleWebKit/534.46 (KHTML, like Gecko) Version/5.1 Mobile/9B206 "
+      "Safari/7534.48.3";
+  const std::string unknown = "unknown client";
+  const std::vector<uap_cpp::Field> key_fields{uap_cpp::Field::kBrowserFamily,
+                                               uap_cpp::Field::kBrowserMajor};
+
+  uap_cpp::Aggregator first(g_ua_parser, key_fields);
+  first.add(iphone);
+  first.add(iphone, 2);
+  first.add(unknown);
+  EXPECT_EQ(first.parsed(), 2u);
+
+  uap_cpp::Aggregator second(g_ua_parser, key_fields, 1);
+  second.add(unknown);
+  second.add(iphone);
+  second.add(unknown);
+  EXPECT_EQ(second.parsed(), 3u);
+
+  first.merge(second);
+  const auto counts = first.counts();
+  ASSERT_EQ(counts.size(), 2u);
+  EXPECT_EQ(counts[0].key, std::vector<std::string>({"Mobile Safari", "5"}));
+  EXPECT_EQ(counts[0].count, 4u);
+  EXPECT_EQ(counts[1].key, std::vector<std::string>({"Other", ""}));
+  EXPECT_EQ(counts[1].count, 3u);
+
+  // Any byte may occur in key fields
+  uap_cpp::Aggregator raw(g_ua_parser,
+                          {uap_cpp::Field::kUserAgentString,
+                           uap_cpp::Field::kBrowserFamily});
+  const std::string nul("a\0b", 3);
+  raw.add(nul);
+  raw.add(std::string_view(nul.data(), 1));
+  const auto raw_counts = raw.counts();
+  ASSERT_EQ(raw_counts.size(), 2u);
+  EXPECT_EQ(raw_counts[0].key, std::vector<std::string>({"a", "Other"}));
+  EXPECT_EQ(raw_counts[1].key, std::vector<std::string>({nul, "Other"}));
+}
+
+TEST(Aggregator, aggregate_in_parallel) {
+  std::vector<std::string> user_agents;
+  std::string input;
+  for (int i = 0; i < 1000; ++i) {
+    user_agents.emplace_back(i % 3 ? "curl/7.68.0" : "Wget/1.20.3 (linux-gnu)");
+    input += user_agents.back() + "\n";
+  }
+  const std::vector<uap_cpp::Field> key_fields{uap_cpp::Field::kBrowserFamily};
+
+  const auto counts =
+      uap_cpp::aggregate(g_ua_parser, user_agents, key_fields, 4);
+  ASSERT_EQ(counts.size(), 2u);
+  EXPECT_EQ(counts[0].key, std::vector<std::string>({"curl"}));
+  EXPECT_EQ(counts[0].count, 666u);
+  EXPECT_EQ(counts[1].key, std::vector<std::string>({"Wget"}));
+  EXPECT_EQ(counts[1].count, 334u);
+
+  std::istringstream stream(input);
+  const auto stream_counts =
+      uap_cpp::aggregate(g_ua_parser, stream, key_fields, 4);
+  ASSERT_EQ(stream_counts.size(), 2u);
+  EXPECT_EQ(stream_counts[0].count, 666u);
+  EXPECT_EQ(stream_counts[1].count, 334u);
+}
+
+std::string run_pipeline(uap_cpp::BlockReader& reader, unsigned threads) {
+  std::string written;
+  uap_cpp::BlockPipeline::run(
+      reader,
+      [](std::string_view block, std::string& output) {
+        uap_cpp::for_each_line(block, [&](std::string_view line) {
+          output.append(line.rbegin(), line.rend());
+          output += '\n';
+        });
+      },
+      [&](const std::string& output) { written += output; },
+      threads,
+      3);
+  return written;
+}
+
+TEST(BlockPipeline, preserves_order) {
+  std::string input;
+  std::string expected;
+  for (int i = 0; i < 10000; ++i) {
+    std::string line = "line " + std::to_string(i);
+    input += line + (i % 2 ? "\r\n" : "\n");
+    expected.append(line.rbegin(), line.rend());
+    expected += '\n';
+  }
+
+  uap_cpp::MemoryBlockReader memory_reader(input, 64);
+  EXPECT_EQ(run_pipeline(memory_reader, 4), expected);
+
+  std::istringstream stream(input);
+  uap_cpp::StreamBlockReader stream_reader(stream, 100);
+  EXPECT_EQ(run_pipeline(stream_reader, 4), expected);
+}
+
+void test_line_aligned_blocks(uap_cpp::BlockReader& reader,
+                              const std::string& input) {
+  std::string joined;
+  uap_cpp::Block block;
+  while (reader.next(block)) {
+    ASSERT_FALSE(block.data.empty());
+    joined += block.data;
+    if (joined.size() < input.size()) {
+      EXPECT_EQ(block.data.back(), '\n');
+    }
+  }
+  EXPECT_EQ(joined, input);
+}
+
+TEST(BlockPipeline, blocks_end_at_line_boundaries) {
+  const std::string input = "aaaaaaaa\nb\ncccccccccccccccccccc\nd";
+
+  for (size_t block_size : {1, 4, 10, 100}) {
+    uap_cpp::MemoryBlockReader memory_reader(input, block_size);
+    test_line_aligned_blocks(memory_reader, input);
+
+    std::istringstream stream(input);
+    uap_cpp::StreamBlockReader stream_reader(stream, block_size);
+    test_line_aligned_blocks(stream_reader, input);
+  }
+}
+
+TEST(BlockPipeline, propagates_errors) {
+  const std::string input = "a\nb\nc\n";
+  uap_cpp::MemoryBlockReader reader(input, 1);
+  EXPECT_THROW(uap_cpp::BlockPipeline::run(
+                   reader,
+                   [](std::string_view block, std::string&) {
+                     if (block == "b\n") {
+                       throw std::runtime_error("failed");
+                     }
+                   },
+                   [](const std::string&) {},
+                   2),
+               std::runtime_error);
+}
 }  // namespace
 
 int main(int argc, char** argv) {
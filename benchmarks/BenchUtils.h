@@ -0,0 +1,57 @@
+#pragma once
+
+#include <yaml-cpp/yaml.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * Helpers shared by the benchmark executables
+ */
+namespace uap_bench {
+
+inline bool ends_with(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * Loads user agent strings from a text file with one string per line, or
+ * from a uap-core test fixture (*.yaml with test_cases/user_agent_string).
+ */
+inline void load_corpus(const std::string& path,
+                        std::vector<std::string>& out) {
+  if (ends_with(path, ".yaml") || ends_with(path, ".yml")) {
+    const auto root = YAML::LoadFile(path);
+    for (const auto& test : root["test_cases"]) {
+      const auto& ua = test["user_agent_string"];
+      if (ua.IsScalar()) {
+        out.push_back(ua.as<std::string>());
+      }
+    }
+  } else {
+    std::ifstream infile(path);
+    std::string line;
+    while (std::getline(infile, line)) {
+      out.push_back(line);
+    }
+  }
+}
+
+/**
+ * Value at the given quantile (0..1) of the samples, which get sorted
+ */
+template <class T>
+T percentile(std::vector<T>& samples, double quantile) {
+  if (samples.empty()) {
+    return T();
+  }
+  std::sort(samples.begin(), samples.end());
+  size_t index = static_cast<size_t>(quantile * (samples.size() - 1) + 0.5);
+  return samples[std::min(index, samples.size() - 1)];
+}
+
+}  // namespace uap_bench
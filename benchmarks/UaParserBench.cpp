@@ -1,4 +1,4 @@
-#include "../UaParser.h"
+#include "../UaParser"
 
 #include <fstream>
 #include <string>
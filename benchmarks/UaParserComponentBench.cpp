@@ -0,0 +1,253 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../UaParser"
+#include "../internal/Pattern.h"
+#include "../internal/UAStore.h"
+#include "BenchUtils.h"
+
+namespace {
+
+using uap_cpp::AgentStore;
+using uap_cpp::DeviceStore;
+using uap_cpp::GenericStoreComparator;
+using uap_cpp::SnippetIndex;
+using uap_cpp::SnippetMapping;
+
+std::vector<std::string> g_corpus;
+
+/**
+ * Inputs of every stage for one category, precomputed so that each stage can
+ * be measured on its own
+ */
+template <class Store>
+struct CategoryData {
+  CategoryData(const char* name,
+               const SnippetIndex& index,
+               const SnippetMapping<const Store*>& mapping)
+      : name(name), index(index), mapping(mapping) {
+    for (const auto& ua : g_corpus) {
+      snippets.push_back(index.getSnippets(ua));
+
+      std::set<const Store*, GenericStoreComparator> found;
+      mapping.getExpressions(snippets.back(), found);
+      candidates.emplace_back(found.begin(), found.end());
+    }
+
+    // Matches are kept in place, Match cannot be copied safely
+    matches.reserve(g_corpus.size());
+    for (size_t i = 0; i < g_corpus.size(); ++i) {
+      for (const Store* store : candidates[i]) {
+        matches.emplace_back();
+        if (store->regExpr.match(g_corpus[i], matches.back())) {
+          matchedStores.push_back(store);
+          break;
+        }
+        matches.pop_back();
+      }
+    }
+  }
+
+  const char* name;
+  const SnippetIndex& index;
+  const SnippetMapping<const Store*>& mapping;
+
+  std::vector<SnippetIndex::SnippetSet> snippets;
+  std::vector<std::vector<const Store*>> candidates;
+  std::vector<uap_cpp::Match> matches;
+  std::vector<const Store*> matchedStores;
+};
+
+template <class Store>
+void expand_templates(const Store& store,
+                      const uap_cpp::Match& m,
+                      std::string& out);
+
+template <>
+void expand_templates(const DeviceStore& store,
+                      const uap_cpp::Match& m,
+                      std::string& out) {
+  store.replacement.expand(m, out);
+  store.brandReplacement.expand(m, out);
+  store.modelReplacement.expand(m, out);
+}
+
+template <>
+void expand_templates(const AgentStore& store,
+                      const uap_cpp::Match& m,
+                      std::string& out) {
+  store.replacement.expand(m, out);
+  store.majorVersionReplacement.expand(m, out);
+  store.minorVersionReplacement.expand(m, out);
+  store.patchVersionReplacement.expand(m, out);
+}
+
+template <class Store>
+void bench_get_snippets(benchmark::State& state,
+                        const CategoryData<Store>* data) {
+  for (auto _ : state) {
+    for (const auto& ua : g_corpus) {
+      benchmark::DoNotOptimize(data->index.getSnippets(ua));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * g_corpus.size());
+}
+
+template <class Store>
+void bench_get_expressions(benchmark::State& state,
+                           const CategoryData<Store>* data) {
+  size_t candidates = 0;
+  for (auto _ : state) {
+    for (const auto& snippets : data->snippets) {
+      std::set<const Store*, GenericStoreComparator> found;
+      data->mapping.getExpressions(snippets, found);
+      candidates += found.size();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * g_corpus.size());
+  state.counters["candidates_per_ua"] = benchmark::Counter(
+      static_cast<double>(candidates) / g_corpus.size(),
+      benchmark::Counter::kAvgIterations);
+}
+
+template <class Store>
+void bench_match(benchmark::State& state, const CategoryData<Store>* data) {
+  uap_cpp::Match m;
+  size_t evaluated = 0;
+  for (auto _ : state) {
+    for (size_t i = 0; i < g_corpus.size(); ++i) {
+      for (const Store* store : data->candidates[i]) {
+        ++evaluated;
+        if (store->regExpr.match(g_corpus[i], m)) {
+          break;
+        }
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * g_corpus.size());
+  state.counters["evaluated_per_ua"] = benchmark::Counter(
+      static_cast<double>(evaluated) / g_corpus.size(),
+      benchmark::Counter::kAvgIterations);
+}
+
+template <class Store>
+void bench_expand(benchmark::State& state, const CategoryData<Store>* data) {
+  std::string out;
+  for (auto _ : state) {
+    for (size_t i = 0; i < data->matchedStores.size(); ++i) {
+      expand_templates(*data->matchedStores[i], data->matches[i], out);
+      benchmark::DoNotOptimize(out.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * data->matchedStores.size());
+}
+
+/**
+ * Times every call separately to report per user agent latency percentiles
+ * on top of the throughput
+ */
+template <class Parse>
+void bench_end_to_end(benchmark::State& state, const Parse& parse) {
+  std::vector<double> latencies;
+  latencies.reserve(g_corpus.size() * 16);
+  for (auto _ : state) {
+    for (const auto& ua : g_corpus) {
+      auto start = std::chrono::steady_clock::now();
+      parse(ua);
+      auto end = std::chrono::steady_clock::now();
+      latencies.push_back(
+          std::chrono::duration<double, std::nano>(end - start).count());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * g_corpus.size());
+  state.counters["p50_ns"] = uap_bench::percentile(latencies, 0.5);
+  state.counters["p99_ns"] = uap_bench::percentile(latencies, 0.99);
+  state.counters["p999_ns"] = uap_bench::percentile(latencies, 0.999);
+}
+
+template <class Store>
+void register_stages(const CategoryData<Store>* data) {
+  const std::string suffix = std::string("/") + data->name;
+  benchmark::RegisterBenchmark(("SnippetIndex::getSnippets" + suffix).c_str(),
+                               bench_get_snippets<Store>,
+                               data);
+  benchmark::RegisterBenchmark(
+      ("SnippetMapping::getExpressions" + suffix).c_str(),
+      bench_get_expressions<Store>,
+      data);
+  benchmark::RegisterBenchmark(
+      ("Pattern::match" + suffix).c_str(), bench_match<Store>, data);
+  benchmark::RegisterBenchmark(
+      ("ReplaceTemplate::expand" + suffix).c_str(), bench_expand<Store>, data);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  benchmark::Initialize(&argc, argv);
+  if (argc < 3) {
+    printf(
+        "Usage: %s <regexes.yaml> <corpus> [<corpus>...] [benchmark flags]\n"
+        "\n"
+        "A corpus is a text file with one user agent per line, or a uap-core\n"
+        "test fixture such as uap-core/tests/test_ua.yaml. Use\n"
+        "--benchmark_format=json or --benchmark_out=<file> for "
+        "machine-readable\nresults.\n",
+        argv[0]);
+    return -1;
+  }
+
+  for (int i = 2; i < argc; ++i) {
+    uap_bench::load_corpus(argv[i], g_corpus);
+  }
+
+  const uap_cpp::UAStore store(argv[1]);
+  const uap_cpp::UserAgentParser parser(argv[1]);
+
+  const CategoryData<DeviceStore> device(
+      "device", store.deviceSnippetIndex, store.deviceMapping);
+  const CategoryData<AgentStore> os(
+      "os", store.osSnippetIndex, store.osMapping);
+  const CategoryData<AgentStore> browser(
+      "browser", store.browserSnippetIndex, store.browserMapping);
+  register_stages(&device);
+  register_stages(&os);
+  register_stages(&browser);
+
+  benchmark::RegisterBenchmark(
+      "UserAgentParser::parse_device", [&](benchmark::State& state) {
+        bench_end_to_end(state, [&](const std::string& ua) {
+          benchmark::DoNotOptimize(parser.parse_device(ua));
+        });
+      });
+  benchmark::RegisterBenchmark(
+      "UserAgentParser::parse_os", [&](benchmark::State& state) {
+        bench_end_to_end(state, [&](const std::string& ua) {
+          benchmark::DoNotOptimize(parser.parse_os(ua));
+        });
+      });
+  benchmark::RegisterBenchmark(
+      "UserAgentParser::parse_browser", [&](benchmark::State& state) {
+        bench_end_to_end(state, [&](const std::string& ua) {
+          benchmark::DoNotOptimize(parser.parse_browser(ua));
+        });
+      });
+  benchmark::RegisterBenchmark(
+      "UserAgentParser::parse", [&](benchmark::State& state) {
+        uap_cpp::UserAgent result;
+        bench_end_to_end(state, [&](const std::string& ua) {
+          parser.parse(ua, result);
+          benchmark::DoNotOptimize(result.browser.family.data());
+        });
+      });
+
+  benchmark::AddCustomContext("corpus_size", std::to_string(g_corpus.size()));
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
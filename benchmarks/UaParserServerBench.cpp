@@ -0,0 +1,165 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../UaParser"
+#include "BenchUtils.h"
+#include "Workload.h"
+
+namespace {
+
+void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options] <socket> <corpus> [<corpus>...]\n"
+          "\n"
+          "Load generator for uap-server: several client connections send "
+          "the user\nagents of the corpora with a skewed popularity, a batch "
+          "at a time, and the\nthroughput and batch latency percentiles are "
+          "reported.\n"
+          "\n"
+          "  -c clients   number of client connections (default: 4)\n"
+          "  -n requests  requests per client (default: 100000)\n"
+          "  -p batch     user agents per ParserClient::parse() call, all "
+          "pipelined\n"
+          "               (default: 32)\n"
+          "  -z exponent  Zipf exponent of the popularity, 0 for uniform "
+          "(default: 1)\n"
+          "  -u churn     fraction of requests with a new unique user agent "
+          "(default: 0.01)\n"
+          "  -s seed      random seed (default: 1)\n",
+          program);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  unsigned clients = 4;
+  size_t requests = 100000;
+  size_t batch = 32;
+  double zipf_exponent = 1;
+  double churn = 0.01;
+  unsigned seed = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:n:p:z:u:s:")) != -1) {
+    switch (opt) {
+      case 'c':
+        clients = std::max(1, atoi(optarg));
+        break;
+      case 'n':
+        requests = static_cast<size_t>(atoll(optarg));
+        break;
+      case 'p':
+        batch = std::max(1, atoi(optarg));
+        break;
+      case 'z':
+        zipf_exponent = atof(optarg);
+        break;
+      case 'u':
+        churn = atof(optarg);
+        break;
+      case 's':
+        seed = static_cast<unsigned>(atoi(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (argc - optind < 2) {
+    usage(argv[0]);
+    return -1;
+  }
+  const std::string socket_path = argv[optind];
+
+  std::vector<std::string> corpus;
+  for (int i = optind + 1; i < argc; ++i) {
+    uap_bench::load_corpus(argv[i], corpus);
+  }
+  if (corpus.empty()) {
+    fprintf(stderr, "Empty corpus\n");
+    return -1;
+  }
+
+  // Requests are generated up front, so that only the round trips are
+  // measured
+  std::vector<std::vector<std::string>> workloads(clients);
+  for (unsigned i = 0; i < clients; ++i) {
+    uap_bench::Workload(corpus, zipf_exponent, churn, seed + i)
+        .generate(requests, workloads[i]);
+  }
+
+  std::vector<std::vector<double>> latencies(clients);
+  std::vector<std::exception_ptr> errors(clients);
+  auto start = std::chrono::steady_clock::now();
+  {
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < clients; ++i) {
+      threads.emplace_back([&, i]() {
+        try {
+          uap_cpp::ParserClient client(socket_path, batch);
+          std::vector<std::string_view> user_agents;
+          std::vector<uap_cpp::UserAgent> results;
+          const auto& workload = workloads[i];
+          for (size_t begin = 0; begin < workload.size(); begin += batch) {
+            const size_t end = std::min(begin + batch, workload.size());
+            user_agents.assign(workload.begin() + begin,
+                               workload.begin() + end);
+            auto batch_start = std::chrono::steady_clock::now();
+            client.parse(user_agents, results);
+            auto batch_end = std::chrono::steady_clock::now();
+            latencies[i].push_back(
+                std::chrono::duration<double, std::nano>(batch_end -
+                                                         batch_start)
+                    .count());
+          }
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  for (const auto& error : errors) {
+    if (error) {
+      try {
+        std::rethrow_exception(error);
+      } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return -1;
+      }
+    }
+  }
+
+  std::vector<double> all;
+  for (const auto& client : latencies) {
+    all.insert(all.end(), client.begin(), client.end());
+  }
+  const size_t total = static_cast<size_t>(clients) * requests;
+
+  printf("clients: %u\n", clients);
+  printf("batch: %zu\n", batch);
+  printf("requests: %zu\n", total);
+  printf("seconds: %.3f\n", seconds);
+  printf("requests_per_second: %.0f\n", total / seconds);
+  printf("batch_p50_ns: %.0f\n", uap_bench::percentile(all, 0.5));
+  printf("batch_p90_ns: %.0f\n", uap_bench::percentile(all, 0.9));
+  printf("batch_p99_ns: %.0f\n", uap_bench::percentile(all, 0.99));
+  printf("batch_p999_ns: %.0f\n", uap_bench::percentile(all, 0.999));
+  printf("batch_max_ns: %.0f\n", all.empty() ? 0 : all.back());
+  return 0;
+}
@@ -0,0 +1,334 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../UaParser"
+#include "BenchUtils.h"
+
+/**
+ * Searches for the user agents that are most expensive to parse with a given
+ * regexes.yaml, by mutating seed user agents and keeping the costliest
+ * results. Inputs that make the parser evaluate a rule no earlier input
+ * reached are kept as well, so that the search explores all rules instead of
+ * refining a single expensive input.
+ */
+
+namespace {
+
+struct Input {
+  std::string ua;
+  double nanoseconds{0};
+  // Rules evaluated and candidate rules selected, over all categories
+  size_t evaluations{0};
+  size_t candidates{0};
+};
+
+class Search {
+ public:
+  Search(const uap_cpp::UserAgentParser& parser,
+         bool by_time,
+         size_t keep,
+         size_t max_length,
+         int repeats,
+         unsigned seed)
+      : parser_(parser),
+        byTime_(by_time),
+        keep_(keep),
+        maxLength_(max_length),
+        repeats_(repeats),
+        random_(seed) {}
+
+  void addSeed(const std::string& ua) {
+    if (ua.size() > maxLength_) {
+      return;
+    }
+    auto explanation = parser_.explain(ua);
+    for (const auto* category :
+         {&explanation.device, &explanation.os, &explanation.browser}) {
+      for (const auto& snippet : category->snippets) {
+        if (dictionarySet_.insert(snippet.text).second) {
+          dictionary_.push_back(snippet.text);
+        }
+      }
+    }
+    consider(ua);
+  }
+
+  void run(size_t iterations) {
+    if (corpus_.empty()) {
+      return;
+    }
+    for (size_t i = 1; i <= iterations; ++i) {
+      // Favor refining the worst inputs, but keep exploring the corpus
+      const auto& pool = !worst_.empty() && pick(2) == 0 ? worst_ : corpus_;
+      std::string ua = pool[pick(pool.size())].ua;
+
+      const size_t mutations = 1 + pick(4);
+      for (size_t m = 0; m < mutations; ++m) {
+        mutate(ua);
+      }
+      if (ua.size() > maxLength_) {
+        ua.resize(maxLength_);
+      }
+      consider(ua);
+
+      if (i % 1000 == 0) {
+        fprintf(stderr,
+                "%zu iterations, corpus %zu, worst %.0f ns / %zu evaluations\n",
+                i,
+                corpus_.size(),
+                worst_.front().nanoseconds,
+                worst_.front().evaluations);
+      }
+    }
+  }
+
+  const std::vector<Input>& worst() const { return worst_; }
+
+ private:
+  size_t pick(size_t n) {
+    return std::uniform_int_distribution<size_t>(0, n - 1)(random_);
+  }
+
+  char randomChar() { return static_cast<char>(' ' + pick('~' - ' ' + 1)); }
+
+  void mutate(std::string& ua) {
+    const size_t pos = ua.empty() ? 0 : pick(ua.size() + 1);
+    switch (pick(6)) {
+      case 0:
+        // Insert a snippet some rule depends on
+        if (!dictionary_.empty()) {
+          ua.insert(pos, dictionary_[pick(dictionary_.size())]);
+        }
+        break;
+      case 1: {
+        // Repeat a substring, growing backtracking-prone runs
+        if (ua.empty()) {
+          break;
+        }
+        const size_t start = pick(ua.size());
+        const size_t length = 1 + pick(std::min<size_t>(16, ua.size() - start));
+        const std::string repeated = ua.substr(start, length);
+        for (size_t n = 1 + pick(8); n > 0; --n) {
+          ua.insert(start, repeated);
+        }
+        break;
+      }
+      case 2:
+        // Delete a range
+        if (!ua.empty()) {
+          const size_t start = pick(ua.size());
+          ua.erase(start, 1 + pick(std::min<size_t>(16, ua.size() - start)));
+        }
+        break;
+      case 3:
+        // Replace or insert a random printable character
+        if (pos < ua.size() && pick(2) == 0) {
+          ua[pos] = randomChar();
+        } else {
+          ua.insert(pos, 1, randomChar());
+        }
+        break;
+      case 4:
+        // Flip the case of a letter
+        if (pos < ua.size() && isalpha(static_cast<unsigned char>(ua[pos]))) {
+          ua[pos] ^= 0x20;
+        }
+        break;
+      default: {
+        // Splice with a piece of another input
+        const auto& other = corpus_[pick(corpus_.size())].ua;
+        if (!other.empty()) {
+          const size_t start = pick(other.size());
+          ua.insert(pos, other, start, 1 + pick(other.size() - start));
+        }
+        break;
+      }
+    }
+  }
+
+  void consider(const std::string& ua) {
+    Input input;
+    input.ua = ua;
+
+    // The minimum of several runs is the least noisy estimate
+    uap_cpp::UserAgent result;
+    input.nanoseconds = 1e300;
+    for (int i = 0; i < repeats_; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      parser_.parse(ua, result);
+      auto end = std::chrono::steady_clock::now();
+      input.nanoseconds = std::min(
+          input.nanoseconds,
+          std::chrono::duration<double, std::nano>(end - start).count());
+    }
+
+    bool new_coverage = false;
+    auto explanation = parser_.explain(ua);
+    int category_index = 0;
+    for (const auto* category :
+         {&explanation.device, &explanation.os, &explanation.browser}) {
+      input.candidates += category->candidates.size();
+      for (const auto& rule : category->candidates) {
+        if (rule.evaluated) {
+          ++input.evaluations;
+          new_coverage |=
+              evaluatedRules_.emplace(category_index, rule.index).second;
+        }
+      }
+      ++category_index;
+    }
+
+    if (new_coverage) {
+      corpus_.push_back(input);
+    }
+    if (worst_.size() < keep_ || cost(input) > cost(worst_.back())) {
+      if (!new_coverage) {
+        corpus_.push_back(input);
+      }
+      auto it = std::upper_bound(
+          worst_.begin(),
+          worst_.end(),
+          input,
+          [this](const Input& a, const Input& b) { return cost(a) > cost(b); });
+      worst_.insert(it, std::move(input));
+      if (worst_.size() > keep_) {
+        worst_.pop_back();
+      }
+    }
+  }
+
+  double cost(const Input& input) const {
+    return byTime_ ? input.nanoseconds : input.evaluations;
+  }
+
+  const uap_cpp::UserAgentParser& parser_;
+  const bool byTime_;
+  const size_t keep_;
+  const size_t maxLength_;
+  const int repeats_;
+  std::mt19937_64 random_;
+
+  std::vector<std::string> dictionary_;
+  std::set<std::string> dictionarySet_;
+  std::set<std::pair<int, size_t>> evaluatedRules_;
+
+  std::vector<Input> corpus_;
+  // Costliest inputs so far, costliest first
+  std::vector<Input> worst_;
+};
+
+void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options] <regexes.yaml> <corpus> [<corpus>...]\n"
+          "\n"
+          "Mutates the user agents of the corpora (text files with one user "
+          "agent per\nline, or uap-core test fixtures) to find the ones that "
+          "are slowest to parse,\nand writes them as TSV: nanoseconds, "
+          "evaluated rules, candidate rules, length,\nuser agent.\n"
+          "\n"
+          "  -m time|evaluations  cost to maximize (default: time)\n"
+          "  -n iterations        number of mutated inputs (default: 100000)\n"
+          "  -k count             number of inputs to keep (default: 100)\n"
+          "  -l bytes             maximum input length (default: 1024)\n"
+          "  -r repeats           timed parses per input (default: 5)\n"
+          "  -s seed              random seed (default: 1)\n"
+          "  -o file              output file (default: stdout)\n",
+          program);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool by_time = true;
+  size_t iterations = 100000;
+  size_t keep = 100;
+  size_t max_length = 1024;
+  int repeats = 5;
+  unsigned seed = 1;
+  std::string output_path;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "m:n:k:l:r:s:o:")) != -1) {
+    switch (opt) {
+      case 'm':
+        if (strcmp(optarg, "evaluations") == 0) {
+          by_time = false;
+        } else if (strcmp(optarg, "time") != 0) {
+          usage(argv[0]);
+          return -1;
+        }
+        break;
+      case 'n':
+        iterations = static_cast<size_t>(atoll(optarg));
+        break;
+      case 'k':
+        keep = std::max<size_t>(1, atoll(optarg));
+        break;
+      case 'l':
+        max_length = static_cast<size_t>(atoll(optarg));
+        break;
+      case 'r':
+        repeats = std::max(1, atoi(optarg));
+        break;
+      case 's':
+        seed = static_cast<unsigned>(atoi(optarg));
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (argc - optind < 2) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  std::vector<std::string> seeds;
+  for (int i = optind + 1; i < argc; ++i) {
+    uap_bench::load_corpus(argv[i], seeds);
+  }
+
+  const uap_cpp::UserAgentParser parser(argv[optind]);
+  Search search(parser, by_time, keep, max_length, repeats, seed);
+  for (const auto& ua : seeds) {
+    search.addSeed(ua);
+  }
+  search.run(iterations);
+
+  FILE* out = stdout;
+  if (!output_path.empty()) {
+    out = fopen(output_path.c_str(), "w");
+    if (!out) {
+      fprintf(stderr, "Cannot open %s\n", output_path.c_str());
+      return -1;
+    }
+  }
+  for (const auto& input : search.worst()) {
+    fprintf(out,
+            "%.0f\t%zu\t%zu\t%zu\t%s\n",
+            input.nanoseconds,
+            input.evaluations,
+            input.candidates,
+            input.ua.size(),
+            input.ua.c_str());
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../UaParser"
+#include "BenchUtils.h"
+
+namespace {
+
+void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options] <regexes.yaml> <corpus> [<corpus>...]\n"
+          "\n"
+          "Measures the latency of the first requests of a new parser, with "
+          "and without\nwarm_up(). Each run starts in a new process, as "
+          "compiled regexes are shared\nby the parsers of a process.\n"
+          "\n"
+          "  -n requests  first requests to measure (default: 1000)\n"
+          "  -w corpus    warm up with this corpus instead of the built-in "
+          "sample\n"
+          "  -t threads   warm-up threads (default: 1)\n"
+          "  -m mode      cold, warm or both (default: both)\n",
+          program);
+}
+
+/**
+ * Loads a parser, optionally warms it up, and reports the latency of the
+ * first requests parsed after that
+ */
+void run(const char* regexes,
+         const std::vector<std::string>& requests,
+         bool warm,
+         const std::vector<std::string>& warm_corpus,
+         size_t threads) {
+  const uap_cpp::UserAgentParser parser(regexes);
+  uap_cpp::WarmUpReport report;
+  if (warm) {
+    report = parser.warm_up(warm_corpus, threads);
+  }
+
+  std::vector<double> latencies;
+  latencies.reserve(requests.size());
+  uap_cpp::UserAgent parsed;
+  double total = 0;
+  for (const auto& ua : requests) {
+    auto start = std::chrono::steady_clock::now();
+    parser.parse(ua, parsed);
+    auto end = std::chrono::steady_clock::now();
+    latencies.push_back(
+        std::chrono::duration<double, std::nano>(end - start).count());
+    total += latencies.back();
+  }
+
+  printf("mode: %s\n", warm ? "warm" : "cold");
+  printf("warm_up_user_agents: %zu\n", report.user_agents);
+  printf("warm_up_ms: %.3f\n", report.nanoseconds / 1e6);
+  printf("requests: %zu\n", latencies.size());
+  printf("mean_ns: %.0f\n", latencies.empty() ? 0 : total / latencies.size());
+  printf("p50_ns: %.0f\n", uap_bench::percentile(latencies, 0.5));
+  printf("p90_ns: %.0f\n", uap_bench::percentile(latencies, 0.9));
+  printf("p99_ns: %.0f\n", uap_bench::percentile(latencies, 0.99));
+  printf("max_ns: %.0f\n", latencies.empty() ? 0 : latencies.back());
+  fflush(stdout);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t requests = 1000;
+  size_t threads = 1;
+  std::string warm_corpus_path;
+  bool cold = true;
+  bool warm = true;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:w:t:m:")) != -1) {
+    switch (opt) {
+      case 'n':
+        requests = static_cast<size_t>(atoll(optarg));
+        break;
+      case 'w':
+        warm_corpus_path = optarg;
+        break;
+      case 't':
+        threads = std::max(1, atoi(optarg));
+        break;
+      case 'm':
+        cold = strcmp(optarg, "warm") != 0;
+        warm = strcmp(optarg, "cold") != 0;
+        if (strcmp(optarg, "both") != 0 && cold == warm) {
+          usage(argv[0]);
+          return -1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (argc - optind < 2) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  std::vector<std::string> corpus;
+  for (int i = optind + 1; i < argc; ++i) {
+    uap_bench::load_corpus(argv[i], corpus);
+  }
+  if (corpus.empty()) {
+    fprintf(stderr, "Empty corpus\n");
+    return -1;
+  }
+  std::vector<std::string> first;
+  for (size_t i = 0; i < requests; ++i) {
+    first.push_back(corpus[i % corpus.size()]);
+  }
+  std::vector<std::string> warm_corpus;
+  if (!warm_corpus_path.empty()) {
+    uap_bench::load_corpus(warm_corpus_path, warm_corpus);
+  }
+
+  for (bool mode : {false, true}) {
+    if (!(mode ? warm : cold)) {
+      continue;
+    }
+    const pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      return -1;
+    }
+    if (pid == 0) {
+      run(argv[optind], first, mode, warm_corpus, threads);
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "Run failed\n");
+      return -1;
+    }
+    if (cold && warm && !mode) {
+      printf("\n");
+      // Not to be written again by the next child
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
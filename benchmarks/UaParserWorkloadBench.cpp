@@ -0,0 +1,212 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "../UaParser"
+#include "BenchUtils.h"
+#include "Workload.h"
+
+namespace {
+
+void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options] <regexes.yaml> <corpus> [<corpus>...]\n"
+          "\n"
+          "Replays the user agents of the corpora (text files with one user "
+          "agent per\nline, or uap-core test fixtures) with a skewed "
+          "popularity, from several\nclient threads, and reports throughput "
+          "and latency percentiles.\n"
+          "\n"
+          "  -z exponent  Zipf exponent of the popularity, 0 for uniform "
+          "(default: 1)\n"
+          "  -u churn     fraction of requests with a new unique user agent "
+          "(default: 0.01)\n"
+          "  -t threads   number of client threads (default: 1)\n"
+          "  -n requests  requests per thread (default: 200000)\n"
+          "  -m mode      parse: UserAgentParser::parse, aggregate: an "
+          "Aggregator per\n"
+          "               thread, which caches parsed user agents, async: "
+          "\n"
+          "               UserAgentParser::parse_async, timing the "
+          "submission only\n"
+          "               (default: parse)\n"
+          "  -w workers   parse_async() worker threads (default: 1)\n"
+          "  -s seed      random seed (default: 1)\n",
+          program);
+}
+
+struct ClientResult {
+  std::vector<double> latencies;
+  uint64_t parsed{0};
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  double zipf_exponent = 1;
+  double churn = 0.01;
+  unsigned threads = 1;
+  size_t requests = 200000;
+  bool aggregate = false;
+  bool async = false;
+  uap_cpp::ParserOptions options;
+  unsigned seed = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "z:u:t:n:m:w:s:")) != -1) {
+    switch (opt) {
+      case 'z':
+        zipf_exponent = atof(optarg);
+        break;
+      case 'u':
+        churn = atof(optarg);
+        break;
+      case 't':
+        threads = std::max(1, atoi(optarg));
+        break;
+      case 'n':
+        requests = static_cast<size_t>(atoll(optarg));
+        break;
+      case 'm':
+        if (strcmp(optarg, "aggregate") == 0) {
+          aggregate = true;
+        } else if (strcmp(optarg, "async") == 0) {
+          async = true;
+        } else if (strcmp(optarg, "parse") != 0) {
+          usage(argv[0]);
+          return -1;
+        }
+        break;
+      case 'w':
+        options.async_threads = static_cast<unsigned>(atoi(optarg));
+        break;
+      case 's':
+        seed = static_cast<unsigned>(atoi(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (argc - optind < 2) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  std::vector<std::string> corpus;
+  for (int i = optind + 1; i < argc; ++i) {
+    uap_bench::load_corpus(argv[i], corpus);
+  }
+  if (corpus.empty()) {
+    fprintf(stderr, "Empty corpus\n");
+    return -1;
+  }
+
+  // Requests are generated up front, so that only parsing is measured
+  std::vector<std::vector<std::string>> workloads(threads);
+  size_t distinct = 0;
+  {
+    std::unordered_set<std::string> seen;
+    for (unsigned i = 0; i < threads; ++i) {
+      uap_bench::Workload(corpus, zipf_exponent, churn, seed + i)
+          .generate(requests, workloads[i]);
+      seen.insert(workloads[i].begin(), workloads[i].end());
+    }
+    distinct = seen.size();
+  }
+
+  const uap_cpp::UserAgentParser parser(argv[optind], options);
+  const std::vector<uap_cpp::Field> key = {uap_cpp::Field::kBrowserFamily,
+                                           uap_cpp::Field::kOsFamily};
+
+  std::vector<ClientResult> results(threads);
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> rejected{0};
+  auto start = std::chrono::steady_clock::now();
+  {
+    std::vector<std::thread> clients;
+    for (unsigned i = 0; i < threads; ++i) {
+      clients.emplace_back([&, i]() {
+        auto& result = results[i];
+        result.latencies.reserve(workloads[i].size());
+
+        uap_cpp::UserAgent parsed;
+        uap_cpp::Aggregator aggregator(parser, key);
+        for (const auto& ua : workloads[i]) {
+          auto request_start = std::chrono::steady_clock::now();
+          if (aggregate) {
+            aggregator.add(ua);
+          } else if (async) {
+            // A full queue is retried, as an event loop would on its next
+            // turn, and the time spent retrying counts
+            while (!parser.parse_async(
+                ua, [&](uap_cpp::UserAgent&&) { ++completed; })) {
+              ++rejected;
+              std::this_thread::yield();
+            }
+          } else {
+            parser.parse(ua, parsed);
+          }
+          auto request_end = std::chrono::steady_clock::now();
+          result.latencies.push_back(
+              std::chrono::duration<double, std::nano>(request_end -
+                                                       request_start)
+                  .count());
+        }
+        result.parsed = aggregate ? aggregator.parsed() : workloads[i].size();
+      });
+    }
+    for (auto& client : clients) {
+      client.join();
+    }
+    if (async) {
+      uint64_t submitted = 0;
+      for (const auto& workload : workloads) {
+        submitted += workload.size();
+      }
+      while (completed.load() < submitted) {
+        std::this_thread::yield();
+      }
+    }
+  }
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  std::vector<double> latencies;
+  uint64_t parsed = 0;
+  for (auto& result : results) {
+    latencies.insert(
+        latencies.end(), result.latencies.begin(), result.latencies.end());
+    parsed += result.parsed;
+  }
+  const size_t total = latencies.size();
+
+  printf("mode: %s\n", aggregate ? "aggregate" : async ? "async" : "parse");
+  printf("threads: %u\n", threads);
+  printf("requests: %zu\n", total);
+  printf("distinct_user_agents: %zu\n", distinct);
+  printf("cache_hit_rate: %.4f\n",
+         total ? 1 - static_cast<double>(parsed) / total : 0);
+  if (async) {
+    printf("async_workers: %u\n", options.async_threads);
+    printf("rejected_submissions: %llu\n",
+           static_cast<unsigned long long>(rejected.load()));
+  }
+  printf("seconds: %.3f\n", seconds);
+  printf("requests_per_second: %.0f\n", total / seconds);
+  printf("p50_ns: %.0f\n", uap_bench::percentile(latencies, 0.5));
+  printf("p90_ns: %.0f\n", uap_bench::percentile(latencies, 0.9));
+  printf("p99_ns: %.0f\n", uap_bench::percentile(latencies, 0.99));
+  printf("p999_ns: %.0f\n", uap_bench::percentile(latencies, 0.999));
+  printf("max_ns: %.0f\n", latencies.empty() ? 0 : latencies.back());
+  return 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace uap_bench {
+
+/**
+ * Generates a stream of user agents resembling real traffic: a few user
+ * agents are very popular and most are rare (Zipf distribution), and a
+ * fraction of requests carry a user agent never seen before.
+ *
+ * The popularity rank of the corpus entries is shuffled with the seed, so it
+ * does not depend on the order of the corpus file.
+ */
+class Workload {
+ public:
+  /**
+   * zipf_exponent is the exponent s of the weights 1/rank^s; 0 is uniform,
+   * and around 1 is typical of web traffic. churn is the fraction of
+   * requests (0..1) with a new unique user agent.
+   */
+  Workload(const std::vector<std::string>& corpus,
+           double zipf_exponent,
+           double churn,
+           uint64_t seed)
+      : corpus_(corpus),
+        churn_(churn),
+        random_(seed),
+        uniquePrefix_(" Build/" + std::to_string(seed) + "-") {
+    std::shuffle(corpus_.begin(), corpus_.end(), random_);
+
+    cumulative_.reserve(corpus_.size());
+    double total = 0;
+    for (size_t rank = 1; rank <= corpus_.size(); ++rank) {
+      total += 1 / std::pow(static_cast<double>(rank), zipf_exponent);
+      cumulative_.push_back(total);
+    }
+  }
+
+  /**
+   * Appends count user agents to out
+   */
+  void generate(size_t count, std::vector<std::string>& out) {
+    if (corpus_.empty()) {
+      return;
+    }
+    std::uniform_real_distribution<double> uniform(0, 1);
+    for (size_t i = 0; i < count; ++i) {
+      const double r = uniform(random_) * cumulative_.back();
+      size_t rank =
+          std::lower_bound(cumulative_.begin(), cumulative_.end(), r) -
+          cumulative_.begin();
+      out.push_back(corpus_[std::min(rank, corpus_.size() - 1)]);
+
+      if (uniform(random_) < churn_) {
+        // Like the build or session tokens that make real user agents unique
+        out.back() += uniquePrefix_;
+        out.back() += std::to_string(unique_++);
+      }
+    }
+  }
+
+ private:
+  std::vector<std::string> corpus_;
+  const double churn_;
+  std::mt19937_64 random_;
+  std::vector<double> cumulative_;
+  const std::string uniquePrefix_;
+  uint64_t unique_{0};
+};
+
+}  // namespace uap_bench
@@ -0,0 +1,242 @@
+#include "../UaParser"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "BlockPipeline.h"
+
+namespace uap_cpp {
+
+namespace {
+
+struct StringHash {
+  typedef void is_transparent;
+  size_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>()(s);
+  }
+};
+
+/**
+ * Appends a key field, prefixed with its size: any byte may occur in parsed
+ * values, so no separator could tell the fields apart
+ */
+void append_key_field(std::string_view field, std::string& key) {
+  const uint32_t size = static_cast<uint32_t>(field.size());
+  key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+  key.append(field.data(), size);
+}
+
+/**
+ * Takes the next field appended by append_key_field() from the front of key
+ */
+std::string_view take_key_field(std::string_view& key) {
+  uint32_t size;
+  memcpy(&size, key.data(), sizeof(size));
+  const auto field = key.substr(sizeof(size), size);
+  key.remove_prefix(sizeof(size) + size);
+  return field;
+}
+
+struct AggregatorState {
+  AggregatorState(const UserAgentParser& parser,
+                  const std::vector<Field>& keyFields,
+                  size_t maxCachedUserAgents)
+      : parser(parser),
+        keyFields(keyFields),
+        maxCachedUserAgents(maxCachedUserAgents) {}
+
+  const UserAgentParser& parser;
+  const std::vector<Field> keyFields;
+  const size_t maxCachedUserAgents;
+
+  std::vector<std::pair<std::string, uint64_t>> counts;
+  std::unordered_map<std::string, size_t, StringHash, std::equal_to<>>
+      keyIndices;
+  std::unordered_map<std::string, size_t, StringHash, std::equal_to<>>
+      userAgentKeys;
+  uint64_t parsed{0};
+
+  UserAgent result;
+  std::string key;
+
+  size_t keyIndex(const std::string& k) {
+    auto it = keyIndices.find(k);
+    if (it != keyIndices.end()) {
+      return it->second;
+    }
+    counts.emplace_back(k, 0);
+    keyIndices.emplace(k, counts.size() - 1);
+    return counts.size() - 1;
+  }
+};
+
+template <class UserAgents>
+std::vector<AggregateCount> aggregate_in_parallel(
+    const UserAgentParser& parser,
+    const UserAgents& user_agents,
+    const std::vector<Field>& key_fields,
+    unsigned threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = static_cast<unsigned>(
+      std::max<size_t>(1, std::min<size_t>(threads, user_agents.size())));
+
+  std::vector<std::unique_ptr<Aggregator>> aggregators;
+  for (unsigned i = 0; i < threads; ++i) {
+    aggregators.emplace_back(new Aggregator(parser, key_fields));
+  }
+
+  const size_t share = (user_agents.size() + threads - 1) / threads;
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back([&, i]() {
+      const size_t end = std::min(user_agents.size(), (i + 1) * share);
+      for (size_t j = i * share; j < end; ++j) {
+        aggregators[i]->add(user_agents[j]);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  for (unsigned i = 1; i < threads; ++i) {
+    aggregators[0]->merge(*aggregators[i]);
+  }
+  return aggregators[0]->counts();
+}
+
+}  // namespace
+
+Aggregator::Aggregator(const UserAgentParser& parser,
+                       const std::vector<Field>& key_fields,
+                       size_t max_cached_user_agents)
+    : state_(new AggregatorState(parser, key_fields, max_cached_user_agents)) {}
+
+Aggregator::~Aggregator() {
+  delete static_cast<AggregatorState*>(state_);
+}
+
+void Aggregator::add(std::string_view ua, uint64_t count) {
+  auto& state = *static_cast<AggregatorState*>(state_);
+
+  auto it = state.userAgentKeys.find(ua);
+  if (it != state.userAgentKeys.end()) {
+    state.counts[it->second].second += count;
+    return;
+  }
+
+  state.parser.parse(ua, state.result);
+  ++state.parsed;
+
+  state.key.clear();
+  for (Field field : state.keyFields) {
+    append_key_field(get_field(state.result, field), state.key);
+  }
+  size_t index = state.keyIndex(state.key);
+  state.counts[index].second += count;
+
+  if (state.maxCachedUserAgents > 0) {
+    if (state.userAgentKeys.size() >= state.maxCachedUserAgents) {
+      state.userAgentKeys.clear();
+    }
+    state.userAgentKeys.emplace(std::string(ua), index);
+  }
+}
+
+void Aggregator::merge(const Aggregator& other) {
+  auto& state = *static_cast<AggregatorState*>(state_);
+  const auto& other_state = *static_cast<const AggregatorState*>(other.state_);
+
+  for (const auto& entry : other_state.counts) {
+    state.counts[state.keyIndex(entry.first)].second += entry.second;
+  }
+  state.parsed += other_state.parsed;
+}
+
+std::vector<AggregateCount> Aggregator::counts() const {
+  const auto& state = *static_cast<const AggregatorState*>(state_);
+
+  std::vector<AggregateCount> out;
+  out.reserve(state.counts.size());
+  for (const auto& entry : state.counts) {
+    AggregateCount count;
+    count.count = entry.second;
+    std::string_view key = entry.first;
+    for (size_t i = 0; i < state.keyFields.size(); ++i) {
+      count.key.emplace_back(take_key_field(key));
+    }
+    out.emplace_back(std::move(count));
+  }
+
+  std::sort(out.begin(),
+            out.end(),
+            [](const AggregateCount& lhs, const AggregateCount& rhs) {
+              return lhs.count != rhs.count ? lhs.count > rhs.count
+                                            : lhs.key < rhs.key;
+            });
+  return out;
+}
+
+uint64_t Aggregator::parsed() const {
+  return static_cast<const AggregatorState*>(state_)->parsed;
+}
+
+std::vector<AggregateCount> aggregate(
+    const UserAgentParser& parser,
+    const std::vector<std::string_view>& user_agents,
+    const std::vector<Field>& key_fields,
+    unsigned threads) {
+  return aggregate_in_parallel(parser, user_agents, key_fields, threads);
+}
+
+std::vector<AggregateCount> aggregate(
+    const UserAgentParser& parser,
+    const std::vector<std::string>& user_agents,
+    const std::vector<Field>& key_fields,
+    unsigned threads) {
+  return aggregate_in_parallel(parser, user_agents, key_fields, threads);
+}
+
+std::vector<AggregateCount> aggregate(const UserAgentParser& parser,
+                                      std::istream& input,
+                                      const std::vector<Field>& key_fields,
+                                      unsigned threads) {
+  // One aggregator per pipeline thread, created on first use
+  std::mutex mutex;
+  std::unordered_map<std::thread::id, std::unique_ptr<Aggregator>> aggregators;
+
+  StreamBlockReader reader(input, 1 << 20);
+  BlockPipeline::run(
+      reader,
+      [&](std::string_view block, std::string&) {
+        Aggregator* aggregator;
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          auto& slot = aggregators[std::this_thread::get_id()];
+          if (!slot) {
+            slot.reset(new Aggregator(parser, key_fields));
+          }
+          aggregator = slot.get();
+        }
+        for_each_line(block,
+                      [&](std::string_view line) { aggregator->add(line); });
+      },
+      [](const std::string&) {},
+      threads);
+
+  Aggregator total(parser, key_fields, 0);
+  for (const auto& entry : aggregators) {
+    total.merge(*entry.second);
+  }
+  return total.counts();
+}
+
+}  // namespace uap_cpp
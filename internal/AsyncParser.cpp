@@ -0,0 +1,90 @@
+#include "AsyncParser.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace uap_cpp {
+
+AsyncParser::AsyncParser(const UserAgentParser& parser,
+                         unsigned threads,
+                         size_t queueSize,
+                         size_t maxBatch)
+    : parser_(parser),
+      queueSize_(std::max<size_t>(1, queueSize)),
+      maxBatch_(std::max<size_t>(1, maxBatch)) {
+  if (!threads) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  try {
+    for (unsigned i = 0; i < threads; ++i) {
+      workers_.emplace_back([this] { work(); });
+    }
+  } catch (...) {
+    // The destructor is not run, and joinable threads must not be destroyed
+    stop();
+    throw;
+  }
+}
+
+AsyncParser::~AsyncParser() {
+  stop();
+}
+
+void AsyncParser::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+bool AsyncParser::submit(std::string ua, Callback callback) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.size() >= queueSize_) {
+      return false;
+    }
+    queue_.push_back({std::move(ua), std::move(callback)});
+  }
+  ready_.notify_one();
+  return true;
+}
+
+void AsyncParser::work() {
+  std::vector<Request> batch;
+  while (true) {
+    batch.clear();
+    bool more;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      const size_t size = std::min(maxBatch_, queue_.size());
+      std::move(queue_.begin(), queue_.begin() + size,
+                std::back_inserter(batch));
+      queue_.erase(queue_.begin(), queue_.begin() + size);
+      more = !queue_.empty();
+    }
+    if (more) {
+      // Another worker can take what is left while this one parses
+      ready_.notify_one();
+    }
+
+    for (auto& request : batch) {
+      UserAgent result;
+      parser_.parse(request.ua, result);
+      try {
+        request.callback(std::move(result));
+      } catch (...) {
+        // A failing callback must not take the worker down
+      }
+    }
+  }
+}
+
+}  // namespace uap_cpp
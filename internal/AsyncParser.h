@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../UaParser"
+
+namespace uap_cpp {
+
+/**
+ * Bounded queue of parse requests served by a pool of worker threads, for
+ * UserAgentParser::parse_async(). Each worker takes up to maxBatch queued
+ * requests at once, so that a burst costs one wake-up and one lock per
+ * batch rather than per request.
+ */
+class AsyncParser {
+ public:
+  using Callback = std::function<void(UserAgent&&)>;
+
+  /**
+   * threads == 0 means one per core. Throws std::system_error, after
+   * stopping the workers already started, if one cannot be started.
+   */
+  AsyncParser(const UserAgentParser& parser,
+              unsigned threads,
+              size_t queueSize,
+              size_t maxBatch);
+
+  /**
+   * Parses the requests still queued before returning
+   */
+  ~AsyncParser();
+
+  AsyncParser(const AsyncParser&) = delete;
+  AsyncParser& operator=(const AsyncParser&) = delete;
+
+  /**
+   * Returns false, without calling callback, if queueSize requests are
+   * already queued
+   */
+  bool submit(std::string ua, Callback callback);
+
+ private:
+  struct Request {
+    std::string ua;
+    Callback callback;
+  };
+
+  void work();
+  // Lets the workers finish the queue and joins them
+  void stop();
+
+  const UserAgentParser& parser_;
+  const size_t queueSize_;
+  const size_t maxBatch_;
+
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<Request> queue_;
+  bool stopping_{false};
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace uap_cpp
@@ -0,0 +1,196 @@
+#include "BlockPipeline.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace uap_cpp {
+
+MemoryBlockReader::MemoryBlockReader(std::string_view input, size_t blockSize)
+    : remaining_(input), blockSize_(std::max<size_t>(blockSize, 1)) {}
+
+bool MemoryBlockReader::next(Block& block) {
+  if (remaining_.empty()) {
+    return false;
+  }
+
+  size_t size = remaining_.size();
+  if (size > blockSize_) {
+    // Extend the block to the end of the line it ends in
+    size_t newline = remaining_.find('\n', blockSize_ - 1);
+    if (newline != std::string_view::npos) {
+      size = newline + 1;
+    }
+  }
+
+  block.storage.clear();
+  block.data = remaining_.substr(0, size);
+  remaining_.remove_prefix(size);
+  return true;
+}
+
+StreamBlockReader::StreamBlockReader(std::istream& input, size_t blockSize)
+    : input_(input), blockSize_(std::max<size_t>(blockSize, 1)) {}
+
+bool StreamBlockReader::next(Block& block) {
+  std::string& storage = block.storage;
+  storage.swap(carry_);
+  carry_.clear();
+
+  while (input_) {
+    size_t size = storage.size();
+    size_t wanted = size < blockSize_ ? blockSize_ - size : blockSize_;
+    storage.resize(size + wanted);
+    input_.read(&storage[size], static_cast<std::streamsize>(wanted));
+    storage.resize(size + static_cast<size_t>(input_.gcount()));
+
+    if (storage.size() >= blockSize_) {
+      size_t newline = storage.rfind('\n');
+      if (newline != std::string::npos) {
+        carry_.assign(storage, newline + 1, std::string::npos);
+        storage.resize(newline + 1);
+        break;
+      }
+      // A single line longer than the block size, keep reading
+    }
+  }
+
+  if (input_.bad()) {
+    throw std::ios_base::failure("Error while reading input");
+  }
+  if (storage.empty()) {
+    return false;
+  }
+  block.data = storage;
+  return true;
+}
+
+void BlockPipeline::run(BlockReader& reader,
+                        const Processor& process,
+                        const Writer& write,
+                        unsigned threads,
+                        size_t maxBlocksInFlight) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  if (maxBlocksInFlight == 0) {
+    maxBlocksInFlight = 2 * static_cast<size_t>(threads);
+  }
+
+  struct Slot {
+    Block block;
+    std::string output;
+    bool done{false};
+  };
+  std::vector<Slot> slots(maxBlocksInFlight);
+
+  std::mutex readMutex;
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t nextRead = 0;
+  size_t nextWrite = 0;
+  bool endOfInput = false;
+  std::exception_ptr error;
+
+  auto fail = [&](std::exception_ptr e) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!error) {
+      error = e;
+    }
+    cv.notify_all();
+  };
+
+  auto worker = [&]() {
+    for (;;) {
+      Slot* slot;
+      {
+        // Blocks are read one at a time, in sequence order
+        std::unique_lock<std::mutex> readLock(readMutex);
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [&]() {
+            return endOfInput || error ||
+                   nextRead - nextWrite < maxBlocksInFlight;
+          });
+          if (endOfInput || error) {
+            return;
+          }
+          slot = &slots[nextRead % maxBlocksInFlight];
+        }
+
+        bool more;
+        try {
+          more = reader.next(slot->block);
+        } catch (...) {
+          fail(std::current_exception());
+          return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!more) {
+          endOfInput = true;
+          cv.notify_all();
+          return;
+        }
+        ++nextRead;
+      }
+
+      try {
+        slot->output.clear();
+        process(slot->block.data, slot->output);
+      } catch (...) {
+        fail(std::current_exception());
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      slot->done = true;
+      cv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back(worker);
+  }
+
+  for (;;) {
+    Slot* slot;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&]() {
+        return error || slots[nextWrite % maxBlocksInFlight].done ||
+               (endOfInput && nextWrite == nextRead);
+      });
+      if (error || !slots[nextWrite % maxBlocksInFlight].done) {
+        break;
+      }
+      slot = &slots[nextWrite % maxBlocksInFlight];
+    }
+
+    try {
+      write(slot->output);
+    } catch (...) {
+      fail(std::current_exception());
+      break;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    slot->done = false;
+    ++nextWrite;
+    cv.notify_all();
+  }
+
+  for (auto& thread : workers) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <string>
+#include <string_view>
+
+namespace uap_cpp {
+
+/**
+ * A chunk of input that only contains complete lines. The data either points
+ * into memory owned by the reader's source (memory-mapped input), or into
+ * the block's own storage (streamed input).
+ */
+struct Block {
+  std::string_view data;
+  std::string storage;
+};
+
+/**
+ * Sequential source of line-aligned blocks
+ */
+class BlockReader {
+ public:
+  virtual ~BlockReader() = default;
+
+  /**
+   * Fills the next block, returns false at the end of the input
+   */
+  virtual bool next(Block&) = 0;
+};
+
+/**
+ * Splits an in-memory buffer at line boundaries, without copying
+ */
+class MemoryBlockReader : public BlockReader {
+ public:
+  MemoryBlockReader(std::string_view input, size_t blockSize);
+
+  bool next(Block&) override;
+
+ private:
+  std::string_view remaining_;
+  size_t blockSize_;
+};
+
+/**
+ * Reads a stream in blocks, carrying incomplete lines over to the next block
+ */
+class StreamBlockReader : public BlockReader {
+ public:
+  StreamBlockReader(std::istream& input, size_t blockSize);
+
+  bool next(Block&) override;
+
+ private:
+  std::istream& input_;
+  size_t blockSize_;
+  std::string carry_;
+};
+
+/**
+ * Processes blocks on several threads and hands the output of each block to
+ * the writer in input order. At most maxBlocksInFlight blocks are read ahead
+ * of the writer, which bounds memory use regardless of the input size.
+ *
+ * The writer runs on the calling thread. An exception thrown by the reader,
+ * a processor or the writer stops the pipeline and is rethrown by run().
+ */
+class BlockPipeline {
+ public:
+  typedef std::function<void(std::string_view input, std::string& output)>
+      Processor;
+  typedef std::function<void(const std::string& output)> Writer;
+
+  static void run(BlockReader& reader,
+                  const Processor& process,
+                  const Writer& write,
+                  unsigned threads = 0,
+                  size_t maxBlocksInFlight = 0);
+};
+
+/**
+ * Calls f with every line of the block, without the line terminator
+ */
+template <class F>
+void for_each_line(std::string_view block, F&& f) {
+  while (!block.empty()) {
+    size_t end = block.find('\n');
+    std::string_view line = block.substr(0, end);
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    f(line);
+    if (end == std::string_view::npos) {
+      break;
+    }
+    block.remove_prefix(end + 1);
+  }
+}
+
+}  // namespace uap_cpp
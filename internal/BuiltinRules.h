@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+
+#include "SnippetIndex.h"
+#include "SnippetMapping.h"
+
+namespace uap_cpp {
+
+/**
+ * Rules and frozen indexes generated from regexes.yaml at build time, see
+ * tools/UaParserRulesGen.cpp. All of it is constant data.
+ */
+struct BuiltinRule {
+  const char* regex;
+  bool caseInsensitive;
+  // As in RuleDefinition, null when unset
+  const char* replacements[4];
+};
+
+struct BuiltinCategory {
+  const BuiltinRule* rules;
+  size_t ruleCount;
+  SnippetIndex::Tables index;
+  SnippetMappingTables mapping;
+  // Rule of every expression of the mapping, by position in rules
+  const uint32_t* mappingRules;
+  size_t mappingRuleCount;
+};
+
+struct BuiltinRules {
+  BuiltinCategory device;
+  BuiltinCategory os;
+  BuiltinCategory browser;
+};
+
+/**
+ * Defined in the generated source, only when the library is built with the
+ * BUILTIN_RULES CMake option (UAP_CPP_BUILTIN_RULES)
+ */
+const BuiltinRules& builtin_rules();
+
+}  // namespace uap_cpp
@@ -0,0 +1,336 @@
+#include "ClientHints.h"
+
+namespace uap_cpp {
+
+namespace {
+
+struct BrowserBrand {
+  std::string_view brand;
+  // Families as named by regexes.yaml
+  std::string_view family;
+  std::string_view mobileFamily;
+};
+
+constexpr BrowserBrand BROWSER_BRANDS[] = {
+    {"Google Chrome", "Chrome", "Chrome Mobile"},
+    {"Microsoft Edge", "Edge", "Edge Mobile"},
+    {"Opera", "Opera", "Opera Mobile"},
+    {"Brave", "Brave", "Brave"},
+    {"Samsung Internet", "Samsung Internet", "Samsung Internet"},
+    {"YaBrowser", "Yandex Browser", "Yandex Browser"},
+    {"Android WebView", "Chrome Mobile WebView", "Chrome Mobile WebView"},
+};
+
+struct Platform {
+  std::string_view platform;
+  std::string_view family;
+  // Whether results from the rules carry a version, which the hints must
+  // then provide as well
+  bool versioned;
+};
+
+constexpr Platform PLATFORMS[] = {
+    {"Windows", "Windows", true},
+    {"macOS", "Mac OS X", true},
+    {"Android", "Android", true},
+    {"iOS", "iOS", true},
+    {"Chrome OS", "Chrome OS", true},
+    {"Linux", "Linux", false},
+};
+
+/**
+ * Brands that Chromium adds in random forms, such as "Not A(Brand", so that
+ * servers do not rely on the exact list
+ */
+bool is_grease(std::string_view brand) {
+  return brand.starts_with("Not") && brand.ends_with("Brand");
+}
+
+const BrowserBrand* find_brand(std::string_view brand) {
+  for (const auto& known : BROWSER_BRANDS) {
+    if (known.brand == brand) {
+      return &known;
+    }
+  }
+  return nullptr;
+}
+
+void skip_spaces(std::string_view& s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+}
+
+void trim(std::string_view& s) {
+  skip_spaces(s);
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+}
+
+/**
+ * Takes a string from the front of s. escaped tells whether value holds
+ * escape sequences, which are left as they are.
+ */
+bool take_string(std::string_view& s, std::string_view& value, bool& escaped) {
+  if (s.empty() || s.front() != '"') {
+    return false;
+  }
+  escaped = false;
+  for (size_t i = 1; i < s.size(); ++i) {
+    const char c = s[i];
+    if (c == '\\') {
+      if (++i == s.size() || (s[i] != '"' && s[i] != '\\')) {
+        return false;
+      }
+      escaped = true;
+    } else if (c == '"') {
+      value = s.substr(1, i - 1);
+      s.remove_prefix(i + 1);
+      return true;
+    } else if (c < 0x20 || c > 0x7e) {
+      return false;
+    }
+  }
+  return false;
+}
+
+bool is_key_char(char c) {
+  return ('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || c == '_' ||
+         c == '-' || c == '.' || c == '*';
+}
+
+/**
+ * Takes the parameters of an item from the front of s, keeping the value of
+ * the "v" parameter if it is a string
+ */
+bool take_parameters(std::string_view& s, std::string_view& version) {
+  while (!s.empty() && s.front() == ';') {
+    s.remove_prefix(1);
+    skip_spaces(s);
+    size_t key_size = 0;
+    while (key_size < s.size() && is_key_char(s[key_size])) {
+      ++key_size;
+    }
+    if (key_size == 0) {
+      return false;
+    }
+    const auto key = s.substr(0, key_size);
+    s.remove_prefix(key_size);
+    if (s.empty() || s.front() != '=') {
+      // A parameter without value is true
+      continue;
+    }
+    s.remove_prefix(1);
+
+    std::string_view value;
+    bool escaped;
+    if (!s.empty() && s.front() == '"') {
+      if (!take_string(s, value, escaped)) {
+        return false;
+      }
+      if (key == "v" && !escaped) {
+        version = value;
+      }
+    } else {
+      // Tokens, numbers and other bare items are not used
+      size_t size = 0;
+      while (size < s.size() && s[size] != ';' && s[size] != ',' &&
+             s[size] != ' ' && s[size] != '\t') {
+        ++size;
+      }
+      if (size == 0) {
+        return false;
+      }
+      s.remove_prefix(size);
+    }
+  }
+  return true;
+}
+
+/**
+ * Assigns the dot-separated components of version, missing ones are empty
+ */
+void assign_version(std::string_view version, Agent& agent) {
+  std::string* components[] = {
+      &agent.major, &agent.minor, &agent.patch, &agent.patch_minor};
+  for (auto* component : components) {
+    const size_t dot = version.find('.');
+    component->assign(version.substr(0, dot));
+    version = dot == std::string_view::npos ? std::string_view()
+                                            : version.substr(dot + 1);
+  }
+}
+
+/**
+ * Leading number of a version, -1 if it does not start with a digit
+ */
+int major_version(std::string_view version) {
+  if (version.empty() || version.front() < '0' || version.front() > '9') {
+    return -1;
+  }
+  int major = 0;
+  for (char c : version) {
+    if (c < '0' || c > '9' || major > 1000000) {
+      break;
+    }
+    major = major * 10 + (c - '0');
+  }
+  return major;
+}
+
+}  // namespace
+
+bool ClientHintsParser::parseString(std::string_view field,
+                                    std::string_view& value) {
+  trim(field);
+  bool escaped;
+  return take_string(field, value, escaped) && !escaped && field.empty();
+}
+
+bool ClientHintsParser::parseBoolean(std::string_view field, bool& value) {
+  trim(field);
+  if (field == "?1") {
+    value = true;
+  } else if (field == "?0") {
+    value = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ClientHintsParser::nextBrand(std::string_view& list,
+                                  std::string_view& brand,
+                                  std::string_view& version) {
+  skip_spaces(list);
+  if (list.empty()) {
+    return false;
+  }
+
+  // The list is only consumed once the whole member parses
+  std::string_view s = list;
+  bool escaped;
+  version = std::string_view();
+  if (!take_string(s, brand, escaped) || !take_parameters(s, version)) {
+    return false;
+  }
+  skip_spaces(s);
+  if (!s.empty()) {
+    if (s.front() != ',') {
+      return false;
+    }
+    s.remove_prefix(1);
+    skip_spaces(s);
+    if (s.empty()) {
+      // Trailing comma
+      return false;
+    }
+  }
+  list = s;
+  return true;
+}
+
+bool ClientHintsParser::parseBrowser(const ClientHints& hints,
+                                     Agent& browser) {
+  const BrowserBrand* known = nullptr;
+  std::string_view version;
+
+  std::string_view list = hints.brands;
+  std::string_view brand;
+  std::string_view brand_version;
+  while (nextBrand(list, brand, brand_version)) {
+    if (is_grease(brand) || brand == "Chromium") {
+      continue;
+    }
+    const auto* found = find_brand(brand);
+    if (!found || known) {
+      // An unknown browser, or two browsers claiming the request
+      return false;
+    }
+    known = found;
+    version = brand_version;
+  }
+  if (!known || !list.empty() || version.empty()) {
+    return false;
+  }
+
+  list = hints.full_version_list;
+  while (nextBrand(list, brand, brand_version)) {
+    if (brand == known->brand && !brand_version.empty()) {
+      version = brand_version;
+      break;
+    }
+  }
+
+  bool mobile = false;
+  parseBoolean(hints.mobile, mobile);
+  browser.family.assign(mobile ? known->mobileFamily : known->family);
+  assign_version(version, browser);
+  return true;
+}
+
+bool ClientHintsParser::parseOs(const ClientHints& hints, Agent& os) {
+  std::string_view platform;
+  if (!parseString(hints.platform, platform)) {
+    return false;
+  }
+  const Platform* known = nullptr;
+  for (const auto& p : PLATFORMS) {
+    if (p.platform == platform) {
+      known = &p;
+      break;
+    }
+  }
+  if (!known) {
+    return false;
+  }
+
+  std::string_view version;
+  if (known->versioned &&
+      (!parseString(hints.platform_version, version) || version.empty())) {
+    return false;
+  }
+
+  if (platform == "Windows") {
+    // The platform version is the Windows API contract version, 1 to 10 on
+    // Windows 10 and 13 or later on Windows 11. Earlier versions report 0,
+    // and their user agent strings are not frozen, so the rules tell them
+    // apart.
+    const int major = major_version(version);
+    if (major < 1) {
+      return false;
+    }
+    version = major >= 13 ? "11" : "10";
+  }
+
+  os.family.assign(known->family);
+  assign_version(version, os);
+  return true;
+}
+
+bool ClientHintsParser::deviceUserAgent(const ClientHints& hints,
+                                        std::string& ua) {
+  std::string_view model;
+  std::string_view platform;
+  if (!parseString(hints.model, model) || model.empty() ||
+      !parseString(hints.platform, platform) || platform != "Android") {
+    return false;
+  }
+
+  // The version the reduced user agent reports, unless a valid one is given
+  std::string_view version;
+  if (!parseString(hints.platform_version, version) ||
+      major_version(version) < 0 ||
+      version.find_first_not_of("0123456789.") != std::string_view::npos) {
+    version = "10";
+  }
+  ua.assign("Mozilla/5.0 (Linux; Android ");
+  ua.append(version);
+  ua.append("; ");
+  ua.append(model);
+  ua.append(" Build/)");
+  return true;
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "../UaParser"
+
+namespace uap_cpp {
+
+/**
+ * Reads results from User-Agent Client Hints headers, for the requests of
+ * Chromium-based browsers. The browser and the OS are filled only when the
+ * hints determine them, and otherwise left to the rules. The device is
+ * left to the device rules, run over a user agent made up from the hints.
+ *
+ * Headers are parsed in place as RFC 8941 structured fields, without
+ * allocating. Values that do not parse are treated as absent.
+ */
+class ClientHintsParser {
+ public:
+  /**
+   * The browser of the first known brand in Sec-CH-UA, skipping GREASE
+   * brands and the Chromium brand shared by all of them. Returns false if
+   * there is none, or if an unknown brand could be the actual browser.
+   */
+  static bool parseBrowser(const ClientHints&, Agent& browser);
+
+  /**
+   * The OS of a known platform, with its version when the platform reports
+   * one. Returns false if the platform is unknown or its version is missing.
+   */
+  static bool parseOs(const ClientHints&, Agent& os);
+
+  /**
+   * A user agent for the device rules, in the form Android browsers sent
+   * before the reduced user agent replaced the model with "K", e.g.
+   * "Mozilla/5.0 (Linux; Android 14; Pixel 7 Build/)". Returns false
+   * without a model, or on other platforms, whose user agents never
+   * carried one.
+   */
+  static bool deviceUserAgent(const ClientHints&, std::string& ua);
+
+  /**
+   * Structured field string item, e.g. "macOS" with the quotes. Escaped
+   * strings are rejected, since value would not be a view of the field.
+   */
+  static bool parseString(std::string_view field, std::string_view& value);
+
+  /**
+   * Structured field boolean item, ?0 or ?1
+   */
+  static bool parseBoolean(std::string_view field, bool& value);
+
+  /**
+   * Takes the next member of a brand list such as Sec-CH-UA, a string with a
+   * "v" parameter, from the front of list. Returns false at the end of the
+   * list or if the rest of it does not parse.
+   */
+  static bool nextBrand(std::string_view& list,
+                        std::string_view& brand,
+                        std::string_view& version);
+};
+
+}  // namespace uap_cpp
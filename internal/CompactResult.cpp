@@ -0,0 +1,99 @@
+#include "CompactResult.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace uap_cpp {
+
+namespace {
+
+constexpr size_t MAX_UA_SIZE = 0xffff;
+constexpr size_t MAX_FIELD_SIZE = 0xff;
+constexpr size_t FIELD_COUNT = 13;
+
+/**
+ * Calls f with every parsed field, in encoding order
+ */
+template <class Result, class F>
+void for_each_field(Result& ua, const F& f) {
+  f(ua.device.family);
+  f(ua.device.brand);
+  f(ua.device.model);
+  for (auto* agent : {&ua.os, &ua.browser}) {
+    f(agent->family);
+    f(agent->major);
+    f(agent->minor);
+    f(agent->patch);
+    f(agent->patch_minor);
+  }
+}
+
+}  // namespace
+
+size_t CompactResult::encodedSize(std::string_view ua,
+                                  const UserAgent& result) {
+  if (ua.size() > MAX_UA_SIZE) {
+    return 0;
+  }
+  size_t size = 2 + ua.size() + FIELD_COUNT;
+  bool fits = true;
+  for_each_field(result, [&](const std::string& field) {
+    fits &= field.size() <= MAX_FIELD_SIZE;
+    size += field.size();
+  });
+  return fits ? size : 0;
+}
+
+void CompactResult::encode(std::string_view ua,
+                           const UserAgent& result,
+                           char* out) {
+  *out++ = static_cast<char>(ua.size() & 0xff);
+  *out++ = static_cast<char>(ua.size() >> 8);
+  memcpy(out, ua.data(), ua.size());
+  out += ua.size();
+
+  for_each_field(result, [&](const std::string& field) {
+    *out++ = static_cast<char>(field.size());
+    memcpy(out, field.data(), field.size());
+    out += field.size();
+  });
+}
+
+bool CompactResult::decode(std::string_view data,
+                           std::string_view ua,
+                           UserAgent& result) {
+  if (data.size() < 2) {
+    return false;
+  }
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data.data());
+  const size_t ua_size = bytes[0] | (bytes[1] << 8);
+  if (ua_size != ua.size() || data.size() < 2 + ua_size ||
+      data.substr(2, ua_size) != ua) {
+    return false;
+  }
+
+  size_t pos = 2 + ua_size;
+  bool valid = true;
+  for_each_field(result, [&](std::string& field) {
+    if (!valid || pos >= data.size()) {
+      valid = false;
+      return;
+    }
+    const size_t size = static_cast<uint8_t>(data[pos++]);
+    if (pos + size > data.size()) {
+      valid = false;
+      return;
+    }
+    field.assign(data.data() + pos, size);
+    pos += size;
+  });
+  if (!valid) {
+    return false;
+  }
+
+  result.ua_string.assign(ua.data(), ua.size());
+  result.limits_hit = LimitsHit();
+  return true;
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "../UaParser"
+
+namespace uap_cpp {
+
+/**
+ * Compact binary form of a user agent string and its parsed result, for
+ * caches: every string prefixed with its length in one byte (two for the
+ * user agent string).
+ */
+class CompactResult {
+ public:
+  /**
+   * Bytes needed to encode the result, 0 if a field is too long to be
+   * encoded
+   */
+  static size_t encodedSize(std::string_view ua, const UserAgent&);
+
+  /**
+   * Writes encodedSize() bytes to out
+   */
+  static void encode(std::string_view ua, const UserAgent&, char* out);
+
+  /**
+   * Decodes the result if data holds the encoding of ua. Result fields are
+   * assigned in place, reusing their capacity.
+   */
+  static bool decode(std::string_view data,
+                     std::string_view ua,
+                     UserAgent& result);
+};
+
+}  // namespace uap_cpp
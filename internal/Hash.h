@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace uap_cpp {
+
+/**
+ * Fast non-cryptographic 64-bit hash, stable across processes and runs (it
+ * keys data shared between processes and saved to disk), for a given seed.
+ */
+inline uint64_t hash64(std::string_view data, uint64_t seed = 0) {
+  constexpr uint64_t kMul = 0x9fb21c651e98df25ULL;
+  uint64_t h = seed ^ (data.size() * kMul);
+
+  const char* p = data.data();
+  size_t remaining = data.size();
+  while (remaining >= 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    h = (h ^ (word * kMul)) * kMul;
+    h ^= h >> 29;
+    p += 8;
+    remaining -= 8;
+  }
+  uint64_t tail = 0;
+  for (size_t i = 0; i < remaining; ++i) {
+    tail |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+  }
+  h = (h ^ (tail * kMul)) * kMul;
+
+  h ^= h >> 32;
+  h *= kMul;
+  h ^= h >> 29;
+  return h;
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,99 @@
+#include "HotUserAgents.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "MemoryUsage.h"
+
+namespace uap_cpp {
+
+namespace {
+
+constexpr size_t SHARDS = 16;
+
+struct StringHash {
+  typedef void is_transparent;
+  size_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>()(s);
+  }
+};
+
+}  // namespace
+
+struct HotUserAgents::Shard {
+  std::mutex mutex;
+  std::unordered_map<std::string, uint64_t, StringHash, std::equal_to<>>
+      counts;
+};
+
+HotUserAgents::HotUserAgents(size_t capacity)
+    : shardCapacity_(std::max<size_t>(1, capacity / SHARDS)),
+      shards_(new Shard[SHARDS]) {}
+
+HotUserAgents::~HotUserAgents() {}
+
+void HotUserAgents::record(std::string_view ua, uint64_t hash) {
+  Shard& shard = shards_[(hash >> 32) % SHARDS];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  auto it = shard.counts.find(ua);
+  if (it != shard.counts.end()) {
+    ++it->second;
+    return;
+  }
+
+  if (shard.counts.size() >= shardCapacity_) {
+    // Decay until a quarter of the shard is free, so that the next inserts
+    // do not decay again
+    while (shard.counts.size() > shardCapacity_ * 3 / 4) {
+      for (auto c = shard.counts.begin(); c != shard.counts.end();) {
+        c->second >>= 1;
+        c = c->second ? std::next(c) : shard.counts.erase(c);
+      }
+    }
+  }
+  shard.counts.emplace(ua, 1);
+}
+
+std::vector<std::string> HotUserAgents::top(size_t count) const {
+  std::vector<std::pair<uint64_t, std::string>> all;
+  for (size_t i = 0; i < SHARDS; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    for (const auto& c : shards_[i].counts) {
+      all.emplace_back(c.second, c.first);
+    }
+  }
+
+  count = std::min(count, all.size());
+  std::partial_sort(
+      all.begin(),
+      all.begin() + count,
+      all.end(),
+      [](const auto& a, const auto& b) { return a.first > b.first; });
+
+  std::vector<std::string> user_agents;
+  user_agents.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    user_agents.push_back(std::move(all[i].second));
+  }
+  return user_agents;
+}
+
+size_t HotUserAgents::memoryUsage() const {
+  size_t bytes = SHARDS * sizeof(Shard);
+  for (size_t i = 0; i < SHARDS; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    const auto& counts = shards_[i].counts;
+    // A node holds the entry, a next pointer and the cached hash
+    bytes += counts.bucket_count() * sizeof(void*) +
+             counts.size() * (sizeof(*counts.begin()) + 2 * sizeof(void*));
+    for (const auto& c : counts) {
+      bytes += string_heap_bytes(c.first);
+    }
+  }
+  return bytes;
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace uap_cpp {
+
+/**
+ * Approximate call counts of the most frequent user agents, in bounded
+ * memory.
+ *
+ * User agents are spread over independently locked shards by hash. When a
+ * shard is full, all its counts are halved and the ones that drop to zero are
+ * forgotten, so that user agents that are no longer seen make room for new
+ * ones.
+ */
+class HotUserAgents {
+ public:
+  explicit HotUserAgents(size_t capacity);
+  ~HotUserAgents();
+
+  HotUserAgents(const HotUserAgents&) = delete;
+  HotUserAgents& operator=(const HotUserAgents&) = delete;
+
+  /**
+   * hash is any hash of ua, used to pick a shard
+   */
+  void record(std::string_view ua, uint64_t hash);
+
+  /**
+   * At most count user agents, most frequent first
+   */
+  std::vector<std::string> top(size_t count) const;
+
+  /**
+   * Estimated bytes of the counts and the user agents they are kept for
+   */
+  size_t memoryUsage() const;
+
+ private:
+  struct Shard;
+
+  const size_t shardCapacity_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+}  // namespace uap_cpp
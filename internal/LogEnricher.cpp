@@ -0,0 +1,92 @@
+#include "../UaParser"
+
+#include "BlockPipeline.h"
+
+namespace uap_cpp {
+
+namespace {
+
+void enrich_lines(const UserAgentParser& parser,
+                  std::string_view block,
+                  const LogEnrichOptions& options,
+                  std::string& output) {
+  thread_local UserAgent result;
+
+  output.reserve(block.size() + block.size() / 2);
+  for_each_line(block, [&](std::string_view line) {
+    parser.parse(find_log_user_agent(line, options.user_agent_field), result);
+
+    output.append(line.data(), line.size());
+    output += '\t';
+    if (options.json) {
+      append_json(result, output);
+    } else {
+      append_tsv(result, options.columns, output);
+    }
+    output += '\n';
+  });
+}
+
+void enrich_blocks(const UserAgentParser& parser,
+                   BlockReader& reader,
+                   const std::function<void(std::string_view)>& write,
+                   const LogEnrichOptions& options) {
+  BlockPipeline::run(
+      reader,
+      [&](std::string_view block, std::string& output) {
+        enrich_lines(parser, block, options, output);
+      },
+      [&](const std::string& output) { write(output); },
+      options.threads);
+}
+
+}  // namespace
+
+std::string_view find_log_user_agent(std::string_view line,
+                                     int quoted_field) noexcept {
+  const char* s = line.data();
+  const char* end = s + line.size();
+  for (int index = 0;; ++index) {
+    while (s != end && *s != '"') {
+      ++s;
+    }
+    if (s == end) {
+      return std::string_view();
+    }
+
+    const char* field_start = ++s;
+    while (s != end && *s != '"') {
+      if (*s == '\\' && s + 1 != end) {
+        ++s;
+      }
+      ++s;
+    }
+    if (s == end) {
+      return std::string_view();
+    }
+
+    if (index == quoted_field) {
+      return std::string_view(field_start,
+                              static_cast<size_t>(s - field_start));
+    }
+    ++s;
+  }
+}
+
+void enrich_log(const UserAgentParser& parser,
+                std::string_view input,
+                const std::function<void(std::string_view)>& write,
+                const LogEnrichOptions& options) {
+  MemoryBlockReader reader(input, options.block_size);
+  enrich_blocks(parser, reader, write, options);
+}
+
+void enrich_log(const UserAgentParser& parser,
+                std::istream& input,
+                const std::function<void(std::string_view)>& write,
+                const LogEnrichOptions& options) {
+  StreamBlockReader reader(input, options.block_size);
+  enrich_blocks(parser, reader, write, options);
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,90 @@
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <system_error>
+
+#ifdef _WIN32
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace uap_cpp {
+
+MappedFile::MappedFile(const std::string& path, bool)
+    : data_(nullptr), size_(0) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  contents_.assign(std::istreambuf_iterator<char>(input),
+                   std::istreambuf_iterator<char>());
+  data_ = contents_.data();
+  size_ = contents_.size();
+}
+
+MappedFile::~MappedFile() {}
+
+bool MappedFile::isRegularFile(const std::string& path) {
+  std::error_code error;
+  return std::filesystem::is_regular_file(path, error);
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace uap_cpp {
+
+MappedFile::MappedFile(const std::string& path, bool sequential)
+    : data_(nullptr), size_(0) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    int error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ > 0) {
+    data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data_ == MAP_FAILED) {
+      int error = errno;
+      ::close(fd);
+      data_ = nullptr;
+      throw std::system_error(error, std::generic_category(), path);
+    }
+    // Input is read front to back, let the kernel read ahead aggressively
+    if (sequential) {
+      ::madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+  }
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    ::munmap(data_, size_);
+  }
+}
+
+bool MappedFile::isRegularFile(const std::string& path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+#endif  // _WIN32
+
+std::string_view MappedFile::data() const {
+  return std::string_view(static_cast<const char*>(data_), size_);
+}
+
+}  // namespace uap_cpp
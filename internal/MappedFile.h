@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace uap_cpp {
+
+/**
+ * Read-only memory mapping of a whole file. On Windows, the file is read
+ * into memory instead.
+ */
+class MappedFile {
+ public:
+  /**
+   * Throws std::system_error if the file cannot be opened or mapped.
+   * sequential tells the kernel that the file is read front to back.
+   */
+  explicit MappedFile(const std::string& path, bool sequential = true);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::string_view data() const;
+
+  /**
+   * Pipes, terminals and other special files cannot be mapped
+   */
+  static bool isRegularFile(const std::string& path);
+
+ private:
+#ifdef _WIN32
+  std::string contents_;
+#endif
+  void* data_;
+  size_t size_;
+};
+
+}  // namespace uap_cpp
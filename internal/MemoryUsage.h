@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace uap_cpp {
+
+/**
+ * Heap bytes owned by a string, 0 while it fits the small string buffer
+ */
+inline size_t string_heap_bytes(const std::string& s) {
+  return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+}
+
+template <class T>
+size_t vector_heap_bytes(const std::vector<T>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+inline size_t vector_heap_bytes(const std::vector<std::string>& v) {
+  size_t bytes = v.capacity() * sizeof(std::string);
+  for (const auto& s : v) {
+    bytes += string_heap_bytes(s);
+  }
+  return bytes;
+}
+
+}  // namespace uap_cpp
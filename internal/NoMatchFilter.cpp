@@ -0,0 +1,61 @@
+#include "NoMatchFilter.h"
+
+namespace uap_cpp {
+
+namespace {
+
+re2::RE2::Options set_options(int64_t max_memory) {
+  re2::RE2::Options options;
+  options.set_max_mem(max_memory);
+  options.set_log_errors(false);
+  return options;
+}
+
+}  // namespace
+
+NoMatchFilter::NoMatchFilter(int64_t max_memory)
+    : set_(new re2::RE2::Set(set_options(max_memory), re2::RE2::UNANCHORED)) {
+}
+
+NoMatchFilter::~NoMatchFilter() {}
+
+void NoMatchFilter::add(const std::string& regex,
+                        bool case_sensitive,
+                        size_t program_size) {
+  if (set_ &&
+      set_->Add(case_sensitive ? regex : "(?i)" + regex, nullptr) < 0) {
+    set_.reset();
+  }
+  // The set keeps the text of every rule
+  patternBytes_ += sizeof(std::string) + regex.size() + 1;
+  programSize_ += program_size;
+}
+
+bool NoMatchFilter::compile() {
+  if (set_ && !set_->Compile()) {
+    set_.reset();
+  }
+  return set_ != nullptr;
+}
+
+bool NoMatchFilter::mayMatch(std::string_view s) const {
+  if (!set_) {
+    return true;
+  }
+  re2::RE2::Set::ErrorInfo error;
+  if (set_->Match(re2::StringPiece(s.data(), s.size()), nullptr, &error)) {
+    return true;
+  }
+  // Running out of memory is not a verdict on the input
+  return error.kind != re2::RE2::Set::kNoError;
+}
+
+size_t NoMatchFilter::memoryUsage() const {
+  if (!set_) {
+    return 0;
+  }
+  // Same estimate per instruction as for a single rule, see Pattern
+  return sizeof(re2::RE2::Set) + patternBytes_ + programSize_ * 16;
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <re2/set.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace uap_cpp {
+
+/**
+ * Tells in a single pass whether any rule of a category can match an input,
+ * so that inputs no rule matches skip the snippet scan and the evaluation of
+ * candidates.
+ *
+ * All rules are combined in a re2::RE2::Set, searched for the earliest match
+ * only. The check is exact rather than a heuristic, but the combined
+ * automaton is built lazily within a memory budget: when it runs out, the
+ * filter lets the input through and it is parsed as usual. The set uses
+ * leftmost-first semantics whatever the rules use, which does not change
+ * whether they match.
+ */
+class NoMatchFilter {
+ public:
+  /**
+   * max_memory is the budget of the combined automaton, shared by its
+   * compiled program and its DFA states
+   */
+  explicit NoMatchFilter(int64_t max_memory);
+  ~NoMatchFilter();
+
+  NoMatchFilter(const NoMatchFilter&) = delete;
+  NoMatchFilter& operator=(const NoMatchFilter&) = delete;
+
+  /**
+   * Adds a rule; a rule that cannot be added disables the filter.
+   * program_size is the instruction count of the rule compiled on its own,
+   * to estimate the size of the combined program.
+   */
+  void add(const std::string& regex, bool case_sensitive, size_t program_size);
+
+  /**
+   * Must be called after all rules are added. Returns false, and disables
+   * the filter, if the rules cannot be compiled within the memory budget.
+   */
+  bool compile();
+
+  /**
+   * False only if no rule matches the input
+   */
+  bool mayMatch(std::string_view) const;
+
+  /**
+   * Estimated bytes of the compiled rules, 0 once the filter is disabled.
+   * Excludes the DFA states built while matching, which are bounded by the
+   * memory budget.
+   */
+  size_t memoryUsage() const;
+
+ private:
+  std::unique_ptr<re2::RE2::Set> set_;
+  size_t patternBytes_{0};
+  size_t programSize_{0};
+};
+
+}  // namespace uap_cpp
@@ -0,0 +1,212 @@
+#include "../UaParser"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+
+namespace uap_cpp {
+
+ParserClient::ParserClient(const std::string&, size_t) : state_(nullptr) {
+  throw std::runtime_error("uap-server is not supported on Windows");
+}
+
+ParserClient::~ParserClient() {}
+
+UserAgent ParserClient::parse(std::string_view) {
+  return UserAgent();
+}
+
+void ParserClient::parse(const std::vector<std::string_view>&,
+                         std::vector<UserAgent>&) {}
+
+}  // namespace uap_cpp
+
+#else
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <system_error>
+
+#include "ServerProtocol.h"
+
+namespace uap_cpp {
+
+namespace {
+
+[[noreturn]] void throw_errno(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+struct ClientState {
+  int fd{-1};
+  size_t maxPipelined{1};
+  uint32_t nextId{0};
+  std::string output;
+  std::string input;
+
+  ~ClientState() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+  /**
+   * Sends what the socket takes of unsent without blocking
+   */
+  void sendSome(std::string_view& unsent) {
+#ifdef MSG_NOSIGNAL
+    const ssize_t written =
+        ::send(fd, unsent.data(), unsent.size(), MSG_NOSIGNAL);
+#else
+    const ssize_t written = ::write(fd, unsent.data(), unsent.size());
+#endif
+    if (written >= 0) {
+      unsent.remove_prefix(written);
+    } else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+      throw_errno("uap-server send");
+    }
+  }
+
+  /**
+   * Sends output and reads the responses to the requests with ids first to
+   * first + count - 1 into results. Responses are read while requests are
+   * still being sent: the server answers what it has received so far and
+   * blocks until its responses are read, so a client that only reads
+   * after sending a large window would block both of them.
+   */
+  void exchange(uint32_t first, size_t count, UserAgent* results) {
+    std::string_view unsent = output;
+    size_t received = 0;
+    size_t consumed = 0;
+    char chunk[1 << 16];
+    while (received < count) {
+      std::string_view pending(input.data() + consumed,
+                               input.size() - consumed);
+      std::string_view payload;
+      while (received < count &&
+             ServerProtocol::nextFrame(pending, payload)) {
+        uint32_t id;
+        if (!ServerProtocol::decodeResponse(payload, id, results[received]) ||
+            id != static_cast<uint32_t>(first + received)) {
+          throw std::runtime_error("Invalid uap-server response");
+        }
+        ++received;
+      }
+      consumed = input.size() - pending.size();
+      if (received == count) {
+        break;
+      }
+
+      pollfd events = {fd, POLLIN, 0};
+      if (!unsent.empty()) {
+        events.events |= POLLOUT;
+      }
+      if (::poll(&events, 1, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw_errno("uap-server poll");
+      }
+      if (events.revents & POLLOUT) {
+        sendSome(unsent);
+      }
+      if (!(events.revents & (POLLIN | POLLHUP | POLLERR))) {
+        continue;
+      }
+      const ssize_t size = ::read(fd, chunk, sizeof(chunk));
+      if (size < 0 &&
+          (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        continue;
+      }
+      if (size < 0) {
+        throw_errno("uap-server receive");
+      }
+      if (size == 0) {
+        throw std::runtime_error("uap-server closed the connection");
+      }
+      input.append(chunk, size);
+    }
+    output.clear();
+    input.erase(0, consumed);
+  }
+};
+
+}  // namespace
+
+ParserClient::ParserClient(const std::string& socket_path,
+                           size_t max_pipelined) {
+  std::unique_ptr<ClientState> state(new ClientState());
+  state->maxPipelined = std::max<size_t>(1, max_pipelined);
+
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + socket_path);
+  }
+  memcpy(address.sun_path, socket_path.data(), socket_path.size());
+
+  state->fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (state->fd < 0) {
+    throw_errno("socket");
+  }
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+  const int on = 1;
+  ::setsockopt(state->fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+  if (::connect(state->fd,
+                reinterpret_cast<const sockaddr*>(&address),
+                sizeof(address)) != 0) {
+    throw_errno(socket_path);
+  }
+  // Reads and writes wait in poll() instead
+  const int flags = ::fcntl(state->fd, F_GETFL);
+  if (flags < 0 || ::fcntl(state->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    throw_errno("fcntl");
+  }
+  state_ = state.release();
+}
+
+ParserClient::~ParserClient() {
+  delete static_cast<ClientState*>(state_);
+}
+
+UserAgent ParserClient::parse(std::string_view ua) {
+  std::vector<UserAgent> results(1);
+  parse(std::vector<std::string_view>{ua}, results);
+  return std::move(results[0]);
+}
+
+void ParserClient::parse(const std::vector<std::string_view>& user_agents,
+                         std::vector<UserAgent>& results) {
+  auto& state = *static_cast<ClientState*>(state_);
+  results.resize(user_agents.size());
+
+  for (size_t begin = 0; begin < user_agents.size();
+       begin += state.maxPipelined) {
+    const size_t end =
+        std::min(begin + state.maxPipelined, user_agents.size());
+    const uint32_t first = state.nextId;
+    for (size_t i = begin; i < end; ++i) {
+      ServerProtocol::appendRequest(state.nextId++, user_agents[i],
+                                    state.output);
+    }
+    state.exchange(first, end - begin, &results[begin]);
+    for (size_t i = begin; i < end; ++i) {
+      results[i].ua_string.assign(user_agents[i].data(),
+                                  user_agents[i].size());
+    }
+  }
+}
+
+}  // namespace uap_cpp
+
+#endif  // _WIN32
@@ -0,0 +1,377 @@
+#include "ParserServer.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+
+namespace uap_cpp {
+
+ParserServer::ParserServer(const UserAgentParser& parser,
+                           const std::string&,
+                           unsigned,
+                           size_t,
+                           size_t)
+    : parser_(parser), maxBatch_(0), maxConnections_(0) {
+  throw std::runtime_error("uap-server is not supported on Windows");
+}
+
+ParserServer::~ParserServer() {}
+
+void ParserServer::run() {}
+
+void ParserServer::stop() {}
+
+}  // namespace uap_cpp
+
+#else
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <latch>
+#include <system_error>
+
+#include "ServerProtocol.h"
+
+namespace uap_cpp {
+
+namespace {
+
+// How long run() stops accepting after running out of resources, and how
+// often it checks for ended connections at the connection limit
+constexpr int PAUSE_MILLISECONDS = 50;
+
+[[noreturn]] void throw_errno(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+/**
+ * Writes all of data, returns false if the connection is gone
+ */
+bool write_all(int fd, std::string_view data) {
+#ifdef MSG_NOSIGNAL
+  constexpr int flags = MSG_NOSIGNAL;
+#else
+  constexpr int flags = 0;
+#endif
+  while (!data.empty()) {
+    const ssize_t written = ::send(fd, data.data(), data.size(), flags);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(written);
+  }
+  return true;
+}
+
+}  // namespace
+
+ParserServer::ParserServer(const UserAgentParser& parser,
+                           const std::string& socketPath,
+                           unsigned threads,
+                           size_t maxBatch,
+                           size_t maxConnections)
+    : parser_(parser),
+      socketPath_(socketPath),
+      maxBatch_(std::max<size_t>(1, maxBatch)),
+      maxConnections_(std::max<size_t>(1, maxConnections)) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + socketPath);
+  }
+  memcpy(address.sun_path, socketPath.data(), socketPath.size());
+
+  listenFd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd_ < 0) {
+    throw_errno("socket");
+  }
+  // A file left by a previous server would make bind() fail
+  ::unlink(socketPath.c_str());
+  if (::bind(listenFd_,
+             reinterpret_cast<const sockaddr*>(&address),
+             sizeof(address)) != 0 ||
+      ::listen(listenFd_, SOMAXCONN) != 0) {
+    const int error = errno;
+    ::close(listenFd_);
+    throw std::system_error(error, std::generic_category(), socketPath);
+  }
+  if (::pipe(wakeFds_) != 0) {
+    const int error = errno;
+    ::close(listenFd_);
+    ::unlink(socketPath.c_str());
+    throw std::system_error(error, std::generic_category(), "pipe");
+  }
+
+  if (!threads) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (unsigned i = 0; i < threads; ++i) {
+    workers_.emplace_back([this] { work(); });
+  }
+}
+
+ParserServer::~ParserServer() {
+  stop();
+  joinConnections(true);
+  {
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    stopWorkers_ = true;
+  }
+  tasksReady_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+  }
+  ::close(wakeFds_[0]);
+  ::close(wakeFds_[1]);
+  ::unlink(socketPath_.c_str());
+}
+
+void ParserServer::run() {
+  pollfd fds[2] = {{listenFd_, POLLIN, 0}, {wakeFds_[0], POLLIN, 0}};
+  bool outOfResources = false;
+  while (!stopped_.load()) {
+    joinConnections(false);
+    // While paused, clients wait in the listen backlog. Ended connections
+    // are only noticed when the timeout expires.
+    const bool paused =
+        outOfResources || connectionCount() >= maxConnections_;
+    fds[0].fd = paused ? -1 : listenFd_;
+    if (::poll(fds, 2, paused ? PAUSE_MILLISECONDS : -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw_errno("poll");
+    }
+    if (fds[1].revents) {
+      break;
+    }
+    outOfResources = false;
+    if (!fds[0].revents) {
+      continue;
+    }
+    const int fd = ::accept(listenFd_, nullptr, nullptr);
+    if (fd < 0) {
+      switch (errno) {
+        case EMFILE:
+        case ENFILE:
+        case ENOBUFS:
+        case ENOMEM:
+          // Connections that end free some
+          outOfResources = true;
+          continue;
+        case EINTR:
+        case ECONNABORTED:
+        case EAGAIN:
+          continue;
+        default:
+          throw_errno("accept");
+      }
+    }
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+    const int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    if (stopped_.load()) {
+      // stop() has already shut down the other connections
+      ::close(fd);
+      break;
+    }
+    const uint64_t id = nextConnectionId_++;
+    std::thread thread;
+    try {
+      thread = std::thread([this, id, fd] { serve(id, fd); });
+    } catch (const std::system_error&) {
+      ::close(fd);
+      outOfResources = true;
+      continue;
+    }
+    connections_.emplace(id, Connection{fd, std::move(thread)});
+  }
+  joinConnections(true);
+
+  // Connections not accepted yet are reset rather than left waiting
+  ::close(listenFd_);
+  listenFd_ = -1;
+}
+
+void ParserServer::stop() {
+  if (stopped_.exchange(true)) {
+    return;
+  }
+  const char byte = 0;
+  while (::write(wakeFds_[1], &byte, 1) < 0 && errno == EINTR) {
+  }
+  // Unblocks the reads of connection threads
+  std::lock_guard<std::mutex> lock(connectionsMutex_);
+  for (auto& connection : connections_) {
+    ::shutdown(connection.second.fd, SHUT_RDWR);
+  }
+}
+
+void ParserServer::serve(uint64_t id, int fd) {
+  std::string input;
+  std::string output;
+  std::vector<uint32_t> ids;
+  std::vector<std::string_view> requests;
+  std::vector<UserAgent> results;
+  char chunk[1 << 16];
+
+  // stop() also shuts the connection down, but a read that has not started
+  // yet would not see that on every platform, while the wake pipe stays
+  // readable once written to
+  pollfd fds[2] = {{fd, POLLIN, 0}, {wakeFds_[0], POLLIN, 0}};
+  try {
+    while (true) {
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      if (fds[1].revents) {
+        break;
+      }
+      const ssize_t size = ::read(fd, chunk, sizeof(chunk));
+      if (size < 0 && errno == EINTR) {
+        continue;
+      }
+      if (size <= 0) {
+        break;
+      }
+      input.append(chunk, size);
+
+      // Every complete request received so far makes one batch
+      std::string_view pending = input;
+      std::string_view payload;
+      ids.clear();
+      requests.clear();
+      bool valid = true;
+      while (valid && ServerProtocol::nextFrame(pending, payload)) {
+        uint32_t request_id;
+        std::string_view ua;
+        valid = ServerProtocol::decodeRequest(payload, request_id, ua);
+        ids.push_back(request_id);
+        requests.push_back(ua);
+      }
+      if (!valid) {
+        break;
+      }
+      if (requests.empty()) {
+        continue;
+      }
+
+      parseBatches(requests, results);
+
+      output.clear();
+      for (size_t i = 0; i < requests.size(); ++i) {
+        ServerProtocol::appendResponse(ids[i], results[i], output);
+      }
+      if (!write_all(fd, output)) {
+        break;
+      }
+      input.erase(0, input.size() - pending.size());
+    }
+  } catch (const std::exception&) {
+    // Protocol errors close the connection
+  }
+
+  std::lock_guard<std::mutex> lock(connectionsMutex_);
+  finished_.push_back(id);
+}
+
+void ParserServer::parseBatches(
+    const std::vector<std::string_view>& requests,
+    std::vector<UserAgent>& results) {
+  if (results.size() < requests.size()) {
+    results.resize(requests.size());
+  }
+  const size_t batches = (requests.size() + maxBatch_ - 1) / maxBatch_;
+  std::latch done(batches);
+  for (size_t begin = 0; begin < requests.size(); begin += maxBatch_) {
+    const size_t end = std::min(begin + maxBatch_, requests.size());
+    submit([&, begin, end] {
+      for (size_t i = begin; i < end; ++i) {
+        parser_.parse(requests[i], results[i]);
+      }
+      done.count_down();
+    });
+  }
+  done.wait();
+  parsed_.fetch_add(requests.size(), std::memory_order_relaxed);
+}
+
+void ParserServer::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    tasks_.push_back(std::move(task));
+  }
+  tasksReady_.notify_one();
+}
+
+void ParserServer::work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(tasksMutex_);
+      tasksReady_.wait(lock,
+                       [this] { return stopWorkers_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+size_t ParserServer::connectionCount() {
+  std::lock_guard<std::mutex> lock(connectionsMutex_);
+  return connections_.size();
+}
+
+void ParserServer::joinConnections(bool all) {
+  std::vector<Connection> joinable;
+  {
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    if (all) {
+      for (auto& connection : connections_) {
+        joinable.push_back(std::move(connection.second));
+      }
+      connections_.clear();
+      finished_.clear();
+    } else {
+      for (uint64_t id : finished_) {
+        auto it = connections_.find(id);
+        if (it != connections_.end()) {
+          joinable.push_back(std::move(it->second));
+          connections_.erase(it);
+        }
+      }
+      finished_.clear();
+    }
+  }
+  for (auto& connection : joinable) {
+    connection.thread.join();
+    ::close(connection.fd);
+  }
+}
+
+}  // namespace uap_cpp
+
+#endif  // _WIN32
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../UaParser"
+
+namespace uap_cpp {
+
+/**
+ * Serves parse requests over a Unix domain socket, in the ServerProtocol
+ * format, with one parser for all clients (POSIX only).
+ *
+ * A thread per connection reads every request the client has sent so far,
+ * splits them into batches of at most maxBatch requests that a pool of
+ * worker threads parses, and writes the responses in request order. The pool
+ * bounds the number of parsing threads however many clients connect, and
+ * maxConnections bounds the connection threads: further clients wait in the
+ * listen backlog until a connection ends. Running out of descriptors or
+ * memory while accepting also only pauses accepting.
+ */
+class ParserServer {
+ public:
+  /**
+   * Listens on socketPath, replacing any file there. Throws
+   * std::system_error if the socket cannot be created.
+   */
+  ParserServer(const UserAgentParser& parser,
+               const std::string& socketPath,
+               unsigned threads = 0,
+               size_t maxBatch = 64,
+               size_t maxConnections = 256);
+  ~ParserServer();
+
+  ParserServer(const ParserServer&) = delete;
+  ParserServer& operator=(const ParserServer&) = delete;
+
+  /**
+   * Accepts connections until stop() is called
+   */
+  void run();
+
+  /**
+   * Closes the socket and all connections, and makes run() return. May be
+   * called from any thread.
+   */
+  void stop();
+
+  /**
+   * Requests parsed so far
+   */
+  uint64_t parsed() const { return parsed_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Connection {
+    // Closed once the thread is joined, so that stop() never shuts down a
+    // reused descriptor
+    int fd;
+    std::thread thread;
+  };
+
+  void serve(uint64_t id, int fd);
+  void parseBatches(const std::vector<std::string_view>& requests,
+                    std::vector<UserAgent>& results);
+  void submit(std::function<void()> task);
+  void work();
+  void joinConnections(bool all);
+  size_t connectionCount();
+
+  const UserAgentParser& parser_;
+  const std::string socketPath_;
+  const size_t maxBatch_;
+  const size_t maxConnections_;
+  int listenFd_{-1};
+  // Written to by stop() to wake up run()
+  int wakeFds_[2]{-1, -1};
+  std::atomic<bool> stopped_{false};
+  std::atomic<uint64_t> parsed_{0};
+
+  // Worker pool
+  std::mutex tasksMutex_;
+  std::condition_variable tasksReady_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopWorkers_{false};
+  std::vector<std::thread> workers_;
+
+  // Connections by id, and the ids of the ones that ended
+  std::mutex connectionsMutex_;
+  uint64_t nextConnectionId_{0};
+  std::map<uint64_t, Connection> connections_;
+  std::vector<uint64_t> finished_;
+};
+
+}  // namespace uap_cpp
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../UaParser"
+#include "AsyncParser.h"
+#include "HotUserAgents.h"
+#include "NoMatchFilter.h"
+#include "RuleOverlay.h"
+#include "SharedCache.h"
+#include "StatsCollector.h"
+#include "UAStore.h"
+#include "WarmCache.h"
+
+namespace uap_cpp {
+
+/**
+ * Everything a UserAgentParser owns besides the rules file path
+ */
+struct ParserState {
+  /**
+   * Loads the rules from a regexes.yaml path or from BuiltinRules
+   */
+  template <class Rules>
+  ParserState(const Rules& rules, const ParserOptions& options)
+      : options(options), store(rules, options) {
+    if (options.collect_stats) {
+      stats.reset(new StatsCollector({store.deviceStore.size(),
+                                      store.osStore.size(),
+                                      store.browserStore.size()}));
+    }
+    if (!options.shared_cache_path.empty()) {
+      sharedCache.reset(new SharedCache(options.shared_cache_path,
+                                        options.shared_cache_entries));
+    }
+    if (!options.warm_cache_path.empty()) {
+      warmCache.reset(new WarmCache(options.warm_cache_path));
+    }
+    if (options.hot_user_agents) {
+      hotUserAgents.reset(new HotUserAgents(options.hot_user_agents));
+    }
+    if (options.no_match_filter) {
+      addFilter(Category::kDevice, store.deviceStore);
+      addFilter(Category::kOs, store.osStore);
+      addFilter(Category::kBrowser, store.browserStore);
+    }
+  }
+
+  const ParserOptions options;
+  const UAStore store;
+  std::unique_ptr<StatsCollector> stats;
+  std::unique_ptr<SharedCache> sharedCache;
+  std::unique_ptr<WarmCache> warmCache;
+  std::unique_ptr<HotUserAgents> hotUserAgents;
+  std::unique_ptr<NoMatchFilter> filters[StatsCollector::CATEGORIES];
+  // Set by UserAgentParser::warm_up()
+  mutable std::atomic<bool> warm{false};
+
+  StatsCollector::CategoryCounters* counters(Category category) const {
+    if (!stats) {
+      return nullptr;
+    }
+    return &stats->local().categories[static_cast<size_t>(category)];
+  }
+
+  const NoMatchFilter* filter(Category category) const {
+    return filters[static_cast<size_t>(category)].get();
+  }
+
+  /**
+   * The overlay stays alive for as long as the caller holds it, even if it
+   * is replaced meanwhile
+   */
+  std::shared_ptr<const RuleOverlay> overlay() const {
+    // Skips the atomic shared_ptr, which takes a lock, until an overlay is set
+    if (!hasOverlay_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return overlay_.load();
+  }
+
+  void setOverlay(std::shared_ptr<const RuleOverlay> overlay) const {
+    hasOverlay_.store(true, std::memory_order_release);
+    overlay_.store(std::move(overlay));
+  }
+
+  /**
+   * Workers of UserAgentParser::parse_async(), started by its first call
+   */
+  AsyncParser& async(const UserAgentParser& parser) const {
+    std::call_once(asyncOnce_, [&] {
+      async_.reset(new AsyncParser(parser,
+                                   options.async_threads,
+                                   options.async_queue_size,
+                                   options.async_max_batch));
+    });
+    return *async_;
+  }
+
+ private:
+  template <class Store>
+  void addFilter(Category category, const std::vector<Store>& stores) {
+    std::unique_ptr<NoMatchFilter> filter(
+        new NoMatchFilter(options.no_match_filter_memory));
+    for (const auto& store : stores) {
+      filter->add(store.regExpr.pattern(),
+                  store.regExpr.caseSensitive(),
+                  store.regExpr.programSize());
+    }
+    // Without a filter, parsing falls back to the snippet index alone
+    if (filter->compile()) {
+      filters[static_cast<size_t>(category)] = std::move(filter);
+    }
+  }
+
+  mutable std::atomic<std::shared_ptr<const RuleOverlay>> overlay_;
+  mutable std::atomic<bool> hasOverlay_{false};
+  mutable std::once_flag asyncOnce_;
+  // Last, so that queued requests are parsed before anything they use is
+  // destroyed
+  mutable std::unique_ptr<AsyncParser> async_;
+};
+
+}  // namespace uap_cpp
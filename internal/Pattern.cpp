@@ -1,32 +1,189 @@
 #include "Pattern.h"
 
-#include "MakeUnique.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+#include "MemoryUsage.h"
 
 namespace uap_cpp {
 
+namespace {
+
+/**
+ * Compiled expressions by options, the budget they were compiled with and
+ * expression. Entries are removed by the deleter of their expression.
+ */
+class PatternPool {
+ public:
+  static PatternPool& instance() {
+    // Never destroyed, patterns in static storage may outlive it otherwise
+    static PatternPool* pool = new PatternPool;
+    return *pool;
+  }
+
+  std::shared_ptr<const re2::RE2> get(const std::string& pattern,
+                                      bool case_sensitive,
+                                      const PatternOptions& options) {
+    const std::string flags = std::string(1, case_sensitive ? 'c' : 'i') +
+                              (options.longestMatch ? 'l' : 'f');
+    const auto key = [&](int64_t budget) {
+      return flags + std::to_string(budget) + ':' + pattern;
+    };
+    const int64_t cap = options.maxMemoryCap ? options.maxMemoryCap
+                                             : re2::RE2::Options().max_mem();
+    {
+      // Any budget the expression may grow to serves as well, so that
+      // parsers with different shares of a total budget share expressions
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int64_t budget = options.maxMemory;;
+           budget = std::min(budget * 2, cap)) {
+        auto it = entries_.find(key(budget));
+        if (it != entries_.end()) {
+          if (auto regex = it->second.lock()) {
+            return regex;
+          }
+        }
+        if (!options.maxMemory || budget >= cap) {
+          break;
+        }
+      }
+    }
+
+    // Compiled without the lock, so that parsers can load in parallel
+    re2::RE2::Options re2_options;
+    re2_options.set_case_sensitive(case_sensitive);
+    re2_options.set_longest_match(options.longestMatch);
+    if (options.maxMemory) {
+      re2_options.set_max_mem(options.maxMemory);
+      re2_options.set_log_errors(false);
+    }
+    std::unique_ptr<re2::RE2> regex(new re2::RE2(pattern, re2_options));
+    int64_t budget = options.maxMemory;
+    if (options.maxMemory) {
+      // The budget grows in steps, so that a tight one does not end up
+      // costing more than no budget at all
+      while (regex->error_code() == re2::RE2::ErrorPatternTooLarge &&
+             budget < cap) {
+        budget = std::min(budget * 2, cap);
+        re2_options.set_max_mem(budget);
+        regex.reset(new re2::RE2(pattern, re2_options));
+      }
+      if (regex->error_code() == re2::RE2::ErrorPatternTooLarge) {
+        throw std::runtime_error("Regex does not fit in " +
+                                 std::to_string(cap) +
+                                 " bytes: " + pattern);
+      }
+      if (!regex->ok()) {
+        // Logged as without a budget
+        re2_options.set_log_errors(true);
+        regex.reset(new re2::RE2(pattern, re2_options));
+      }
+    }
+    std::shared_ptr<const re2::RE2> compiled(
+        regex.release(),
+        [this, key = key(budget)](const re2::RE2* r) { release(key, r); });
+
+    std::shared_ptr<const re2::RE2> existing;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto& entry = entries_[key(budget)];
+      existing = entry.lock();
+      if (!existing) {
+        entry = compiled;
+        return compiled;
+      }
+    }
+    // Another thread compiled the same expression in the meantime
+    return existing;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+ private:
+  void release(const std::string& key, const re2::RE2* regex) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // The expression may have been compiled again since it expired
+      auto it = entries_.find(key);
+      if (it != entries_.end() && it->second.expired()) {
+        entries_.erase(it);
+      }
+    }
+    delete regex;
+  }
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::weak_ptr<const re2::RE2>> entries_;
+};
+
+/**
+ * Printable ASCII without regex metacharacters, which matches as a plain
+ * substring
+ */
+bool is_literal(const std::string& pattern) {
+  if (pattern.empty()) {
+    return false;
+  }
+  for (char c : pattern) {
+    if (c < ' ' || c > '~' || strchr("\\^$.|?*+()[]{}", c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
 Pattern::Pattern() : groupCount_(0) {}
 
-Pattern::Pattern(const std::string& pattern, bool case_sensitive)
+Pattern::Pattern(const std::string& pattern,
+                 bool case_sensitive,
+                 const PatternOptions& options)
     : groupCount_(0) {
-  assign(pattern, case_sensitive);
+  assign(pattern, case_sensitive, options);
 }
 
-void Pattern::assign(const std::string& pattern, bool case_sensitive) {
+void Pattern::assign(const std::string& pattern,
+                     bool case_sensitive,
+                     const PatternOptions& options) {
   // Add parentheses around expression for capture group 0
   std::string pattern_with_zero_group = "(" + pattern + ")";
 
-  re2::RE2::Options options;
-  options.set_case_sensitive(case_sensitive);
-
-  regex_ = uap_cpp::make_unique<re2::RE2>(pattern_with_zero_group, options);
+  regex_ = PatternPool::instance().get(
+      pattern_with_zero_group, case_sensitive, options);
 
+  overBudget_ =
+      options.maxMemory && regex_->options().max_mem() > options.maxMemory;
   groupCount_ = regex_->NumberOfCapturingGroups();
   if (groupCount_ > Match::MAX_MATCHES) {
     groupCount_ = Match::MAX_MATCHES;
   }
+
+  literal_.clear();
+  if (options.literalFastPath && case_sensitive && is_literal(pattern)) {
+    literal_ = pattern;
+  }
 }
 
-bool Pattern::match(const std::string& s, Match& m) const {
+bool Pattern::match(const re2::StringPiece& s, Match& m) const {
+  if (!literal_.empty()) {
+    // The only group is capture group 0, the literal itself
+    if (std::string_view(s.data(), s.size()).find(literal_) !=
+        std::string_view::npos) {
+      m.strings_[0] = literal_;
+      m.count_ = groupCount_;
+      return true;
+    }
+    m.count_ = 0;
+    return false;
+  }
   if (regex_ && re2::RE2::PartialMatchN(s, *regex_, m.argPtrs_, groupCount_)) {
     m.count_ = groupCount_;
     return true;
@@ -35,6 +192,41 @@ bool Pattern::match(const std::string& s, Match& m) const {
   return false;
 }
 
+std::string Pattern::pattern() const {
+  if (!regex_) {
+    return std::string();
+  }
+  // Strip the parentheses added for capture group 0
+  const std::string& pattern_with_zero_group = regex_->pattern();
+  return pattern_with_zero_group.substr(1, pattern_with_zero_group.size() - 2);
+}
+
+bool Pattern::caseSensitive() const {
+  return !regex_ || regex_->options().case_sensitive();
+}
+
+size_t Pattern::programSize() const {
+  return regex_ ? regex_->ProgramSize() : 0;
+}
+
+size_t Pattern::memoryUsage() const {
+  if (!regex_) {
+    return 0;
+  }
+  // An instruction takes 8 bytes, plus about as much again in the per-
+  // instruction tables of the program
+  return sizeof(re2::RE2) + string_heap_bytes(regex_->pattern()) +
+         regex_->ProgramSize() * 16 + string_heap_bytes(literal_);
+}
+
+bool Pattern::overBudget() const {
+  return overBudget_;
+}
+
+size_t Pattern::compiledCount() {
+  return PatternPool::instance().size();
+}
+
 Match::Match() {
   for (size_t i = 0; i < MAX_MATCHES; i++) {
     args_[i] = &strings_[i];
@@ -8,21 +8,78 @@ namespace uap_cpp {
 
 class Match;
 
+struct PatternOptions {
+  // re2's max_mem, for the compiled program and the DFA caches. 0 means
+  // re2's default.
+  int64_t maxMemory{0};
+  // Most that maxMemory may grow to for an expression whose program does
+  // not fit in it. 0 means re2's default.
+  int64_t maxMemoryCap{0};
+  bool longestMatch{false};
+  // Match expressions without metacharacters with a substring search
+  bool literalFastPath{true};
+};
+
 /**
- * Wrapper around a re2 regular expression
+ * Wrapper around a re2 regular expression.
+ *
+ * Compiled expressions are shared by all patterns of the process with the
+ * same expression, case sensitivity and options, e.g. across the categories
+ * of a parser and across parsers loaded with similar rules, and freed with
+ * the last pattern that uses them. An expression whose program does not fit
+ * in maxMemory is compiled again with twice the budget, up to maxMemoryCap;
+ * assign() throws std::runtime_error if it does not fit in that either. An
+ * expression already compiled with any of these budgets is shared, whatever
+ * budget it started from.
  */
 class Pattern {
  public:
   Pattern();
-  Pattern(const std::string&, bool case_sensitive = true);
+  Pattern(const std::string&,
+          bool case_sensitive = true,
+          const PatternOptions& = PatternOptions());
+
+  void assign(const std::string&,
+              bool case_sensitive = true,
+              const PatternOptions& = PatternOptions());
+
+  bool match(const re2::StringPiece&, Match&) const;
+
+  /**
+   * The expression this pattern was assigned
+   */
+  std::string pattern() const;
+
+  bool caseSensitive() const;
+
+  /**
+   * Number of instructions of the compiled expression, as a measure of its
+   * cost
+   */
+  size_t programSize() const;
+
+  /**
+   * Estimated bytes of the compiled expression. Excludes the DFA states re2
+   * builds while matching, which are bounded by its max_mem option.
+   */
+  size_t memoryUsage() const;
 
-  void assign(const std::string&, bool case_sensitive = true);
+  /**
+   * Whether the expression needed more than PatternOptions::maxMemory
+   */
+  bool overBudget() const;
 
-  bool match(const std::string&, Match&) const;
+  /**
+   * Number of distinct compiled expressions in use in the process
+   */
+  static size_t compiledCount();
 
  private:
-  std::unique_ptr<re2::RE2> regex_;
+  std::shared_ptr<const re2::RE2> regex_;
   size_t groupCount_;
+  bool overBudget_{false};
+  // Set when the expression is a plain string matched by literalFastPath
+  std::string literal_;
 };
 
 /**
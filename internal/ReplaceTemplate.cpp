@@ -1,5 +1,6 @@
 #include "ReplaceTemplate.h"
 
+#include "MemoryUsage.h"
 #include "Pattern.h"
 
 namespace uap_cpp {
@@ -32,12 +33,23 @@ bool ReplaceTemplate::empty() const {
   return chunks_.empty();
 }
 
+size_t ReplaceTemplate::memoryUsage() const {
+  return vector_heap_bytes(chunks_) + vector_heap_bytes(matchIndices_);
+}
+
 std::string ReplaceTemplate::expand(const Match& m) const {
+  std::string s;
+  expand(m, s);
+  return s;
+}
+
+void ReplaceTemplate::expand(const Match& m, std::string& s) const {
   if (chunks_.size() == 1) {
-    return chunks_[0];
+    s = chunks_[0];
+    return;
   }
 
-  std::string s;
+  s.clear();
   if (approximateSize_ > 0) {
     s.reserve(approximateSize_);
   }
@@ -52,8 +64,6 @@ std::string ReplaceTemplate::expand(const Match& m) const {
     }
     ++index;
   }
-
-  return s;
 }
 
 }  // namespace uap_cpp
@@ -17,6 +17,12 @@ class ReplaceTemplate {
 
   bool empty() const;
   std::string expand(const Match&) const;
+  void expand(const Match&, std::string& out) const;
+
+  /**
+   * Heap bytes of the template chunks
+   */
+  size_t memoryUsage() const;
 
  private:
   std::vector<std::string> chunks_;
@@ -0,0 +1,236 @@
+#include "ResultWriter.h"
+
+#include "../UaParser"
+
+namespace uap_cpp {
+
+namespace {
+
+const std::string empty_string;
+
+const char hex_digits[] = "0123456789abcdef";
+
+inline void append_json_value(const std::string& value, std::string& out) {
+  append_json_string(value.data(), value.size(), out);
+}
+
+inline void append_json_nullable(const std::string& value, std::string& out) {
+  if (value.empty()) {
+    out.append("null", 4);
+  } else {
+    append_json_string(value.data(), value.size(), out);
+  }
+}
+
+inline void append_json_agent(const Agent& agent,
+                              bool with_patch_minor,
+                              std::string& out) {
+  out.append("{\"family\":", 10);
+  append_json_value(agent.family, out);
+  out.append(",\"major\":", 9);
+  append_json_nullable(agent.major, out);
+  out.append(",\"minor\":", 9);
+  append_json_nullable(agent.minor, out);
+  out.append(",\"patch\":", 9);
+  append_json_nullable(agent.patch, out);
+  if (with_patch_minor) {
+    out.append(",\"patch_minor\":", 15);
+    append_json_nullable(agent.patch_minor, out);
+  }
+  out += '}';
+}
+
+}  // namespace
+
+void append_json_string(const char* data, size_t size, std::string& out) {
+  out += '"';
+  const char* end = data + size;
+  const char* run_start = data;
+  for (const char* s = data; s != end; ++s) {
+    unsigned char c = static_cast<unsigned char>(*s);
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    out.append(run_start, static_cast<size_t>(s - run_start));
+    run_start = s + 1;
+    switch (c) {
+      case '"':
+        out.append("\\\"", 2);
+        break;
+      case '\\':
+        out.append("\\\\", 2);
+        break;
+      case '\n':
+        out.append("\\n", 2);
+        break;
+      case '\r':
+        out.append("\\r", 2);
+        break;
+      case '\t':
+        out.append("\\t", 2);
+        break;
+      default: {
+        char escaped[6] = {'\\', 'u', '0', '0', hex_digits[c >> 4],
+                           hex_digits[c & 0xf]};
+        out.append(escaped, 6);
+      }
+    }
+  }
+  out.append(run_start, static_cast<size_t>(end - run_start));
+  out += '"';
+}
+
+void append_tsv_value(const char* data, size_t size, std::string& out) {
+  const char* end = data + size;
+  const char* run_start = data;
+  for (const char* s = data; s != end; ++s) {
+    char escaped;
+    switch (*s) {
+      case '\\':
+        escaped = '\\';
+        break;
+      case '\t':
+        escaped = 't';
+        break;
+      case '\n':
+        escaped = 'n';
+        break;
+      case '\r':
+        escaped = 'r';
+        break;
+      default:
+        continue;
+    }
+    out.append(run_start, static_cast<size_t>(s - run_start));
+    out += '\\';
+    out += escaped;
+    run_start = s + 1;
+  }
+  out.append(run_start, static_cast<size_t>(end - run_start));
+}
+
+const std::string& get_field(const UserAgent& ua, Field field) noexcept {
+  switch (field) {
+    case Field::kUserAgentString:
+      return ua.ua_string;
+    case Field::kDeviceFamily:
+      return ua.device.family;
+    case Field::kDeviceBrand:
+      return ua.device.brand;
+    case Field::kDeviceModel:
+      return ua.device.model;
+    case Field::kOsFamily:
+      return ua.os.family;
+    case Field::kOsMajor:
+      return ua.os.major;
+    case Field::kOsMinor:
+      return ua.os.minor;
+    case Field::kOsPatch:
+      return ua.os.patch;
+    case Field::kOsPatchMinor:
+      return ua.os.patch_minor;
+    case Field::kBrowserFamily:
+      return ua.browser.family;
+    case Field::kBrowserMajor:
+      return ua.browser.major;
+    case Field::kBrowserMinor:
+      return ua.browser.minor;
+    case Field::kBrowserPatch:
+      return ua.browser.patch;
+    case Field::kBrowserPatchMinor:
+      return ua.browser.patch_minor;
+  }
+  return empty_string;
+}
+
+const char* field_name(Field field) noexcept {
+  switch (field) {
+    case Field::kUserAgentString:
+      return "user_agent_string";
+    case Field::kDeviceFamily:
+      return "device_family";
+    case Field::kDeviceBrand:
+      return "device_brand";
+    case Field::kDeviceModel:
+      return "device_model";
+    case Field::kOsFamily:
+      return "os_family";
+    case Field::kOsMajor:
+      return "os_major";
+    case Field::kOsMinor:
+      return "os_minor";
+    case Field::kOsPatch:
+      return "os_patch";
+    case Field::kOsPatchMinor:
+      return "os_patch_minor";
+    case Field::kBrowserFamily:
+      return "browser_family";
+    case Field::kBrowserMajor:
+      return "browser_major";
+    case Field::kBrowserMinor:
+      return "browser_minor";
+    case Field::kBrowserPatch:
+      return "browser_patch";
+    case Field::kBrowserPatchMinor:
+      return "browser_patch_minor";
+  }
+  return "";
+}
+
+const std::vector<Field>& default_columns() {
+  static const std::vector<Field> columns{Field::kBrowserFamily,
+                                          Field::kBrowserMajor,
+                                          Field::kBrowserMinor,
+                                          Field::kBrowserPatch,
+                                          Field::kOsFamily,
+                                          Field::kOsMajor,
+                                          Field::kOsMinor,
+                                          Field::kOsPatch,
+                                          Field::kDeviceFamily,
+                                          Field::kDeviceBrand,
+                                          Field::kDeviceModel};
+  return columns;
+}
+
+void append_json(const UserAgent& ua, std::string& out) {
+  out.append("{\"user_agent\":", 14);
+  append_json_agent(ua.browser, false, out);
+  out.append(",\"os\":", 6);
+  append_json_agent(ua.os, true, out);
+  out.append(",\"device\":{\"family\":", 20);
+  append_json_value(ua.device.family, out);
+  out.append(",\"brand\":", 9);
+  append_json_nullable(ua.device.brand, out);
+  out.append(",\"model\":", 9);
+  append_json_nullable(ua.device.model, out);
+  out.append("},\"string\":", 11);
+  append_json_value(ua.ua_string, out);
+  out += '}';
+}
+
+void append_tsv(const UserAgent& ua,
+                const std::vector<Field>& columns,
+                std::string& out) {
+  bool first = true;
+  for (Field field : columns) {
+    if (!first) {
+      out += '\t';
+    }
+    first = false;
+    const std::string& value = get_field(ua, field);
+    append_tsv_value(value.data(), value.size(), out);
+  }
+}
+
+void append_tsv_header(const std::vector<Field>& columns, std::string& out) {
+  bool first = true;
+  for (Field field : columns) {
+    if (!first) {
+      out += '\t';
+    }
+    first = false;
+    out += field_name(field);
+  }
+}
+
+}  // namespace uap_cpp
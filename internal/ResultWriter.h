@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+namespace uap_cpp {
+
+/**
+ * Appends a value as a quoted JSON string, escaping quotes, backslashes and
+ * control characters. Other bytes are copied as-is.
+ */
+void append_json_string(const char* data, size_t size, std::string& out);
+
+/**
+ * Appends a value as a TSV column, escaping backslashes, tabs, carriage
+ * returns and newlines.
+ */
+void append_tsv_value(const char* data, size_t size, std::string& out);
+
+}  // namespace uap_cpp
@@ -0,0 +1,111 @@
+#include "RuleDefinitions.h"
+
+#ifdef UAP_CPP_NO_YAML
+#include <stdexcept>
+#else
+#include <yaml-cpp/yaml.h>
+
+#include <cassert>
+#endif
+
+namespace uap_cpp {
+
+#ifdef UAP_CPP_NO_YAML
+
+RuleDefinitions RuleDefinitions::load(const std::string&) {
+  throw std::runtime_error(
+      "uap-cpp was built without yaml-cpp, only the built-in rules can be "
+      "used");
+}
+
+#else
+
+namespace {
+
+RuleDefinition device_rule(const YAML::Node& device_parser) {
+  RuleDefinition rule;
+  for (auto it = device_parser.begin(); it != device_parser.end(); ++it) {
+    const auto& key = it->first.as<std::string>();
+    const auto& value = it->second.as<std::string>();
+    if (key == "regex") {
+      rule.regex = value;
+    } else if (key == "regex_flag" && value == "i") {
+      rule.caseInsensitive = true;
+    } else if (key == "device_replacement") {
+      rule.replacements[0] = value;
+    } else if (key == "brand_replacement") {
+      rule.replacements[1] = value;
+    } else if (key == "model_replacement") {
+      rule.replacements[2] = value;
+    } else {
+      assert(false);
+    }
+  }
+  return rule;
+}
+
+RuleDefinition agent_rule(const YAML::Node& node,
+                          const std::string& repl,
+                          const std::string& major_repl,
+                          const std::string& minor_repl,
+                          const std::string& patch_repl) {
+  RuleDefinition rule;
+  assert(node.Type() == YAML::NodeType::Map);
+  for (auto it = node.begin(); it != node.end(); ++it) {
+    const auto& key = it->first.as<std::string>();
+    const auto& value = it->second.as<std::string>();
+    if (key == "regex") {
+      rule.regex = value;
+    } else if (key == repl) {
+      rule.replacements[0] = value;
+    } else if (key == major_repl && !value.empty()) {
+      if (value != "$2") {
+        rule.replacements[1] = value;
+      }
+    } else if (key == minor_repl && !value.empty()) {
+      if (value != "$3") {
+        rule.replacements[2] = value;
+      }
+    } else if (key == patch_repl && !value.empty()) {
+      if (value != "$4") {
+        rule.replacements[3] = value;
+      }
+    } else {
+      // Ignore invalid key.
+    }
+  }
+  return rule;
+}
+
+}  // namespace
+
+RuleDefinitions RuleDefinitions::load(const std::string& regexes_file_path) {
+  auto regexes = YAML::LoadFile(regexes_file_path);
+  RuleDefinitions rules;
+
+  for (const auto& user_agent : regexes["user_agent_parsers"]) {
+    rules.browser.push_back(agent_rule(user_agent,
+                                       "family_replacement",
+                                       "v1_replacement",
+                                       "v2_replacement",
+                                       "v3_replacement"));
+  }
+
+  for (const auto& o : regexes["os_parsers"]) {
+    rules.os.push_back(agent_rule(o,
+                                  "os_replacement",
+                                  "os_v1_replacement",
+                                  "os_v2_replacement",
+                                  "os_v3_replacement"));
+  }
+
+  for (const auto& device_parser : regexes["device_parsers"]) {
+    rules.device.push_back(device_rule(device_parser));
+  }
+
+  return rules;
+}
+
+#endif  // UAP_CPP_NO_YAML
+
+}  // namespace uap_cpp
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace uap_cpp {
+
+/**
+ * One rule of regexes.yaml, as written in the file. Replacements that are not
+ * given, or that repeat the default capture group (such as a major version of
+ * "$2"), are left unset; an empty replacement is not the same as none.
+ */
+struct RuleDefinition {
+  std::string regex;
+  bool caseInsensitive{false};
+  // Device rules: device, brand and model replacements. Agent rules: family,
+  // major, minor and patch replacements.
+  std::optional<std::string> replacements[4];
+};
+
+struct RuleDefinitions {
+  /**
+   * Reads regexes.yaml. Throws if the library was built without yaml-cpp.
+   */
+  static RuleDefinitions load(const std::string& regexes_file_path);
+
+  std::vector<RuleDefinition> device;
+  std::vector<RuleDefinition> os;
+  std::vector<RuleDefinition> browser;
+};
+
+}  // namespace uap_cpp
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "../UaParser"
+#include "Hash.h"
+#include "RuleDefinitions.h"
+#include "RuleSubset.h"
+#include "UAStore.h"
+
+namespace uap_cpp {
+
+/**
+ * Rules set with UserAgentParser::set_overlay(), in a store of their own.
+ * The subset options of the parser do not apply to them.
+ */
+struct RuleOverlay {
+  RuleOverlay(const RuleDefinitions& rules,
+              OverlayPosition position,
+              const ParserOptions& options,
+              uint64_t baseFingerprint)
+      : store(rules, RuleSubset::withAllRules(options)),
+        position(position),
+        fingerprint(hash64(
+            std::string_view(reinterpret_cast<const char*>(&store.fingerprint),
+                             sizeof(store.fingerprint)),
+            baseFingerprint + static_cast<uint64_t>(position) + 1)) {}
+
+  const UAStore store;
+  const OverlayPosition position;
+  // Fingerprint of the parser rules combined with the overlay, for caches
+  const uint64_t fingerprint;
+};
+
+}  // namespace uap_cpp
@@ -0,0 +1,281 @@
+#include "RuleSubset.h"
+
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+
+namespace uap_cpp {
+
+namespace {
+
+/**
+ * Position just past the character class starting at regex[i]
+ */
+size_t skip_class(const std::string& regex, size_t i) {
+  ++i;
+  if (i < regex.size() && regex[i] == '^') {
+    ++i;
+  }
+  // A leading ] is a literal
+  if (i < regex.size() && regex[i] == ']') {
+    ++i;
+  }
+  while (i < regex.size() && regex[i] != ']') {
+    if (regex[i] == '\\') {
+      ++i;
+    } else if (regex.compare(i, 2, "[:") == 0) {
+      // [:alpha:] and the like
+      const size_t end = regex.find(":]", i + 2);
+      if (end != std::string::npos) {
+        i = end + 1;
+      }
+    }
+    ++i;
+  }
+  return std::min(i + 1, regex.size());
+}
+
+/**
+ * Length of the name part of a named group starting at regex[i], as in
+ * "(?P<name>", 0 if the group at i is not named
+ */
+size_t named_group_prefix(const std::string& regex, size_t i) {
+  size_t name = 0;
+  if (regex.compare(i, 4, "(?P<") == 0) {
+    name = i + 4;
+  } else if (regex.compare(i, 3, "(?<") == 0) {
+    name = i + 3;
+  } else {
+    return 0;
+  }
+  const size_t end = regex.find('>', name);
+  return end == std::string::npos ? 0 : end + 1 - i;
+}
+
+std::string trimmed(const std::string& s) {
+  const size_t begin = s.find_first_not_of(' ');
+  if (begin == std::string::npos) {
+    return std::string();
+  }
+  return s.substr(begin, s.find_last_not_of(' ') + 1 - begin);
+}
+
+/**
+ * The literals the group body can match, false if it is anything but a
+ * choice between literals
+ */
+bool literal_alternatives(const std::string& body,
+                          std::vector<std::string>& literals) {
+  literals.assign(1, std::string());
+  for (size_t i = 0; i < body.size(); ++i) {
+    const char c = body[i];
+    if (c == '|') {
+      literals.emplace_back();
+    } else if (c == '\\') {
+      // Escaped punctuation is literal, \d and the like are not
+      if (++i == body.size() ||
+          std::isalnum(static_cast<unsigned char>(body[i]))) {
+        return false;
+      }
+      literals.back() += body[i];
+    } else if (std::string_view(".^$*+?{}[]()").find(c) !=
+               std::string_view::npos) {
+      return false;
+    } else {
+      literals.back() += c;
+    }
+  }
+  return true;
+}
+
+/**
+ * Body of the first capture group of regex, false if there is none or it
+ * contains other groups
+ */
+bool first_capture(const std::string& regex, std::string& body) {
+  size_t i = 0;
+  size_t begin = std::string::npos;
+  while (i < regex.size()) {
+    const char c = regex[i];
+    if (c == '\\') {
+      i += 2;
+    } else if (c == '[') {
+      i = skip_class(regex, i);
+    } else if (c == '(') {
+      if (begin != std::string::npos) {
+        return false;
+      }
+      const size_t named = named_group_prefix(regex, i);
+      if (named) {
+        begin = i + named;
+      } else if (regex.compare(i, 2, "(?") != 0) {
+        begin = i + 1;
+      }
+      i = begin == std::string::npos ? i + 1 : begin;
+    } else if (c == ')' && begin != std::string::npos) {
+      body = regex.substr(begin, i - begin);
+      return true;
+    } else {
+      ++i;
+    }
+  }
+  return false;
+}
+
+/**
+ * Whether an inline flag such as (?i) makes part of regex case-insensitive
+ */
+bool has_case_insensitive_flag(const std::string& regex) {
+  for (size_t i = regex.find("(?"); i != std::string::npos;
+       i = regex.find("(?", i + 2)) {
+    size_t j = i + 2;
+    while (j < regex.size() &&
+           std::isalpha(static_cast<unsigned char>(regex[j]))) {
+      if (regex[j++] == 'i') {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * Whether the rule may produce one of the selected families
+ */
+bool is_selected(const RuleDefinition& rule,
+                 const std::vector<std::string>& selected) {
+  std::vector<std::string> families;
+  if (!RuleSubset::families(rule, families)) {
+    return true;
+  }
+  for (const auto& family : families) {
+    if (std::find(selected.begin(), selected.end(), family) !=
+        selected.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<RuleDefinition> select_category(
+    const std::vector<RuleDefinition>& rules,
+    bool load,
+    const std::vector<std::string>& selected) {
+  if (!load) {
+    return {};
+  }
+  if (selected.empty()) {
+    return rules;
+  }
+
+  std::vector<bool> keep(rules.size());
+  size_t end = 0;
+  for (size_t i = 0; i < rules.size(); ++i) {
+    keep[i] = is_selected(rules[i], selected);
+    if (keep[i]) {
+      end = i + 1;
+    }
+  }
+
+  std::vector<RuleDefinition> subset;
+  subset.reserve(end);
+  for (size_t i = 0; i < end; ++i) {
+    if (keep[i]) {
+      subset.push_back(rules[i]);
+      continue;
+    }
+    // Matches as before, with the result of no match: no captures means
+    // no version or model taken from the input
+    RuleDefinition blocker;
+    blocker.regex = RuleSubset::withoutCaptures(rules[i].regex);
+    blocker.caseInsensitive = rules[i].caseInsensitive;
+    blocker.replacements[0] = "Other";
+    subset.push_back(std::move(blocker));
+  }
+  return subset;
+}
+
+}  // namespace
+
+bool RuleSubset::active(const ParserOptions& options) {
+  return !options.load_device_rules || !options.load_os_rules ||
+         !options.load_browser_rules || !options.device_families.empty() ||
+         !options.os_families.empty() || !options.browser_families.empty();
+}
+
+ParserOptions RuleSubset::withAllRules(ParserOptions options) {
+  options.load_device_rules = true;
+  options.load_os_rules = true;
+  options.load_browser_rules = true;
+  options.device_families.clear();
+  options.os_families.clear();
+  options.browser_families.clear();
+  return options;
+}
+
+RuleDefinitions RuleSubset::select(const RuleDefinitions& rules,
+                                   const ParserOptions& options) {
+  RuleDefinitions subset;
+  subset.device = select_category(
+      rules.device, options.load_device_rules, options.device_families);
+  subset.os =
+      select_category(rules.os, options.load_os_rules, options.os_families);
+  subset.browser = select_category(
+      rules.browser, options.load_browser_rules, options.browser_families);
+  return subset;
+}
+
+bool RuleSubset::families(const RuleDefinition& rule,
+                          std::vector<std::string>& families) {
+  families.clear();
+  const auto& replacement = rule.replacements[0];
+  if (replacement && replacement->find('$') == std::string::npos) {
+    families.push_back(trimmed(*replacement));
+    return true;
+  }
+  // Captured text keeps the case of the input
+  if ((replacement && *replacement != "$1") || rule.caseInsensitive ||
+      has_case_insensitive_flag(rule.regex)) {
+    return false;
+  }
+
+  std::string body;
+  if (!first_capture(rule.regex, body) ||
+      !literal_alternatives(body, families)) {
+    families.clear();
+    return false;
+  }
+  for (auto& family : families) {
+    family = trimmed(family);
+  }
+  return true;
+}
+
+std::string RuleSubset::withoutCaptures(const std::string& regex) {
+  std::string result;
+  result.reserve(regex.size() + 16);
+  size_t i = 0;
+  while (i < regex.size()) {
+    const char c = regex[i];
+    if (c == '\\') {
+      result.append(regex, i, 2);
+      i += 2;
+    } else if (c == '[') {
+      const size_t end = skip_class(regex, i);
+      result.append(regex, i, end - i);
+      i = end;
+    } else if (c == '(' && regex.compare(i, 2, "(?") != 0) {
+      result += "(?:";
+      ++i;
+    } else if (c == '(' && named_group_prefix(regex, i)) {
+      result += "(?:";
+      i += named_group_prefix(regex, i);
+    } else {
+      result += c;
+      ++i;
+    }
+  }
+  return result;
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../UaParser"
+#include "RuleDefinitions.h"
+
+namespace uap_cpp {
+
+/**
+ * Reduces rules to the categories and families selected by ParserOptions.
+ *
+ * Within a category, a rule whose families are all outside the selection is
+ * still needed if a selected rule follows it: a user agent it matches would
+ * otherwise fall through to the later rule. Such a rule becomes a blocker,
+ * with its captures removed and "Other" as family, so that it only stops the
+ * search. Rules after the last selected one are dropped, so the others keep
+ * their positions in regexes.yaml.
+ */
+class RuleSubset {
+ public:
+  /**
+   * Whether the options select anything less than all rules
+   */
+  static bool active(const ParserOptions&);
+
+  /**
+   * The options with the selection cleared, for rules that are loaded whole
+   */
+  static ParserOptions withAllRules(ParserOptions);
+
+  static RuleDefinitions select(const RuleDefinitions&, const ParserOptions&);
+
+  /**
+   * Families the rule can produce, if they are known without matching: a
+   * replacement without captures, or a first capture group that is a choice
+   * between literals. Returns false if the family depends on the input.
+   */
+  static bool families(const RuleDefinition&,
+                       std::vector<std::string>& families);
+
+  /**
+   * Turns the capture groups of regex into non-capturing groups, which
+   * changes what is captured but not what matches
+   */
+  static std::string withoutCaptures(const std::string& regex);
+};
+
+}  // namespace uap_cpp
@@ -0,0 +1,162 @@
+#include "SampleUserAgents.h"
+
+namespace uap_cpp {
+
+// Taken from benchmarks/useragents.txt, plus a few crawlers and HTTP
+// libraries
+const char* const SAMPLE_USER_AGENTS[] = {
+    "AppleCoreMedia/1.0.0.12B466 (Apple TV; U; CPU OS 8_1_3 like Mac OS X; "
+    "en_us)",
+    "Mozilla/5.0 (Linux; Android 4.2.2; GT-I9152 Build/JDQ39) "
+    "AppleWebKit/537.36 (KHTML, like Gecko) Chrome/42.0.2311.111 Mobile "
+    "Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 5.1.1) AppleWebKit/537.36 (KHTML, like "
+    "Gecko) Version/4.0 Focus/4.4.1 Chrome/70.0.3538.110 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 5.1.1; SAMSUNG SM-G530R7 Build/LMY47X) "
+    "AppleWebKit/537.36 (KHTML, like Gecko) SamsungBrowser/9.2 "
+    "Chrome/67.0.3396.87 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 5.1; HUAWEI LUA-L22 Build/HUAWEILUA-L22) "
+    "AppleWebKit/537.36 (KHTML, like Gecko) Chrome/50.0.2661.89 Mobile "
+    "Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 6.0.1; SAMSUNG-SM-T377A) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/77.0.3865.92 Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 6.0.1; SM-T560NU) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/77.0.3865.92 Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 7.0; Infinix X571) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 7.0; LGMS210) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 7.0; SM-J327T) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 7.0; ST1009X) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/75.0.3770.143 Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 7.1.1; NX591J) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 7.1.1; Z851M Build/NMF26V) "
+    "AppleWebKit/537.36 (KHTML, like Gecko) Chrome/58.0.3029.83 Mobile "
+    "Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 7.1.2; LG-SP200) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/76.0.3809.132 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 8.0.0; LG-H931) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/76.0.3809.132 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 8.0.0; SM-G570Y) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 8.0.0; SM-J737A) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 8.0.0; moto g(6)) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 8.1.0; LM-Q710(FGN) Build/OPM1.171019.019; "
+    "wv) AppleWebKit/537.36 (KHTML, like Gecko) Version/4.0 "
+    "Chrome/77.0.3865.92 Mobile Safari/537.36 "
+    "[FB_IAB/FB4A;FBAV/235.0.0.38.118;]",
+    "Mozilla/5.0 (Linux; Android 8.1.0; LM-X220PM Build/O11019; wv) "
+    "AppleWebKit/537.36 (KHTML, like Gecko) Version/4.0 Chrome/77.0.3865.92 "
+    "Mobile Safari/537.36;dailymotion-player-sdk-android 0.1.31",
+    "Mozilla/5.0 (Linux; Android 8.1.0; SAMSUNG SM-J727T1 Build/M1AJQ) "
+    "AppleWebKit/537.36 (KHTML, like Gecko) SamsungBrowser/9.4 "
+    "Chrome/67.0.3396.87 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 8.1.0; SM-J727T1) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 8.1.0; vivo 1724) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/76.0.3809.132 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; INE-LX2) AppleWebKit/537.36 (KHTML, like "
+    "Gecko) Chrome/76.0.3809.111 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; ONEPLUS A6000) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; Redmi 7) AppleWebKit/537.36 (KHTML, like "
+    "Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; SAMSUNG SM-G970U) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) SamsungBrowser/10.1 Chrome/71.0.3578.99 Mobile "
+    "Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; SAMSUNG SM-N975U) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) SamsungBrowser/10.1 Chrome/71.0.3578.99 Mobile "
+    "Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; SM-A600T) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; SM-G955U) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; SM-G965U1) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; SM-J337P) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/76.0.3809.132 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; SM-N950U) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; SM-S367VL) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/77.0.3865.92 Mobile Safari/537.36",
+    "Mozilla/5.0 (Linux; Android 9; moto z4) AppleWebKit/537.36 (KHTML, like "
+    "Gecko) Chrome/73.0.3683.90 Mobile Safari/537.36",
+    "Mozilla/5.0 (Macintosh; Intel Mac OS X 10.13; rv:69.0) Gecko/20100101 "
+    "Firefox/69.0",
+    "Mozilla/5.0 (Macintosh; Intel Mac OS X 10_11_6) AppleWebKit/601.7.7 "
+    "(KHTML, like Gecko) Version/9.1.2 Safari/601.7.7",
+    "Mozilla/5.0 (Macintosh; Intel Mac OS X 10_13_4) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/76.0.3809.100 Safari/537.36",
+    "Mozilla/5.0 (Macintosh; Intel Mac OS X 10_14_0) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/77.0.3865.90 Safari/537.36",
+    "Mozilla/5.0 (Macintosh; Intel Mac OS X 10_14_6) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/76.0.3809.132 Safari/537.36",
+    "Mozilla/5.0 (Windows NT 10.0) AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/64.0.3282.140 Safari/537.36 Edge/17.17134",
+    "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/52.0.2743.116 Safari/537.36 Edge/15.15063",
+    "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/75.0.3770.80 Safari/537.36",
+    "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:67.0) Gecko/20100101 "
+    "Firefox/67.0",
+    "Mozilla/5.0 (Windows NT 6.1; Win64; x64) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/67.0.3396.99 Safari/537.36",
+    "Mozilla/5.0 (Windows NT 6.1; rv:69.0) Gecko/20100101 Firefox/69.0",
+    "Mozilla/5.0 (Windows NT 6.3; rv:69.0) Gecko/20100101 Firefox/69.0",
+    "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/77.0.3865.75 Safari/537.36",
+    "Mozilla/5.0 (iPad; CPU OS 10_3_3 like Mac OS X) AppleWebKit/603.3.8 "
+    "(KHTML, like Gecko) Mobile/14G60",
+    "Mozilla/5.0 (iPad; CPU OS 12_0 like Mac OS X) AppleWebKit/605.1.15 "
+    "(KHTML, like Gecko) GSA/83.0.268992909 Mobile/15E148 Safari/605.1",
+    "Mozilla/5.0 (iPad; CPU OS 12_3 like Mac OS X) AppleWebKit/605.1.15 "
+    "(KHTML, like Gecko) CriOS/77.0.3865.93 Mobile/15E148 Safari/605.1",
+    "Mozilla/5.0 (iPad; CPU OS 12_4 like Mac OS X) AppleWebKit/605.1.15 "
+    "(KHTML, like Gecko) Version/12.1.2 Mobile/15E148 Safari/604.1",
+    "Mozilla/5.0 (iPad; CPU OS 9_3_2 like Mac OS X) AppleWebKit/601.1.46 "
+    "(KHTML, like Gecko) Version/9.0 Mobile/13F69 Safari/601.1",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 11_3 like Mac OS X) "
+    "AppleWebKit/605.1.15 (KHTML, like Gecko) Version/11.0 Mobile/15E148 "
+    "Safari/604.1",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 12_1_4 like Mac OS X) "
+    "AppleWebKit/605.1.15 (KHTML, like Gecko) Version/12.0 Mobile/15E148 "
+    "Safari/604.1",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 12_3_1 like Mac OS X) "
+    "AppleWebKit/605.1.15 (KHTML, like Gecko) Mobile/15E148 "
+    "[FBAN/FBIOS;FBDV/iPhone10,6;FBMD/iPhone;FBSN/iOS;FBSV/12.3.1;FBSS/3;FBID"
+    "/phone;FBLC/en_US;FBOP/5;FBCR/AT&T]",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 12_4 like Mac OS X) "
+    "AppleWebKit/605.1.15 (KHTML, like Gecko) GSA/83.0.268992909 "
+    "Mobile/15E148 Safari/605.1",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 12_4_1 like Mac OS X) "
+    "AppleWebKit/605.1.15 (KHTML, like Gecko) Mobile/15E148 "
+    "[FBAN/FBIOS;FBDV/iPhone10,4;FBMD/iPhone;FBSN/iOS;FBSV/12.4.1;FBSS/2;FBID"
+    "/phone;FBLC/es_LA;FBOP/5;FBCR/T-Mobile]",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 12_4_1 like Mac OS X) "
+    "AppleWebKit/605.1.15 (KHTML, like Gecko) Mobile/15E148 "
+    "[FBAN/FBIOS;FBDV/iPhone7,2;FBMD/iPhone;FBSN/iOS;FBSV/12.4.1;FBSS/2;FBID/"
+    "phone;FBLC/en_US;FBOP/5;FBCR/T-Mobile]",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 13_0 like Mac OS X) "
+    "AppleWebKit/605.1.15 (KHTML, like Gecko) Mobile/15E148 "
+    "[FBAN/FBIOS;FBDV/iPhone11,8;FBMD/iPhone;FBSN/iOS;FBSV/13.0;FBSS/2;FBID/p"
+    "hone;FBLC/en_US;FBOP/5;FBCR/T-Mobile]",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 13_1 like Mac OS X) "
+    "AppleWebKit/605.1.15 (KHTML, like Gecko) Mobile/15E148 "
+    "[FBAN/FBIOS;FBDV/iPhone10,6;FBMD/iPhone;FBSN/iOS;FBSV/13.1;FBSS/3;FBID/p"
+    "hone;FBLC/en_US;FBOP/5;FBCR/T-Mobile]",
+    "Mozilla/5.0 (compatible; Googlebot/2.1; +http://www.google.com/bot.html)",
+    "Mozilla/5.0 (compatible; bingbot/2.0; +http://www.bing.com/bingbot.htm)",
+    "Dalvik/2.1.0 (Linux; U; Android 9; SM-G960F Build/PPR1.180610.011)",
+    "okhttp/3.12.1",
+    "curl/7.64.1",
+    "python-requests/2.22.0",
+};
+
+const size_t SAMPLE_USER_AGENT_COUNT =
+    sizeof(SAMPLE_USER_AGENTS) / sizeof(SAMPLE_USER_AGENTS[0]);
+
+}  // namespace uap_cpp
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+namespace uap_cpp {
+
+/**
+ * Representative user agents of web traffic (desktop and mobile browsers,
+ * in-app browsers, crawlers), to warm up parsers without a corpus of their
+ * own
+ */
+extern const char* const SAMPLE_USER_AGENTS[];
+extern const size_t SAMPLE_USER_AGENT_COUNT;
+
+}  // namespace uap_cpp
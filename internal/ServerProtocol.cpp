@@ -0,0 +1,133 @@
+#include "ServerProtocol.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace uap_cpp {
+
+namespace {
+
+void append_uint(uint64_t value, size_t size, std::string& out) {
+  for (size_t i = 0; i < size; ++i) {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+uint64_t read_uint(const char* data, size_t size) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; ++i) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+  }
+  return value;
+}
+
+/**
+ * Calls f with every field of a response, in protocol order
+ */
+template <class Result, class F>
+void for_each_field(Result& ua, const F& f) {
+  f(ua.device.family);
+  f(ua.device.brand);
+  f(ua.device.model);
+  for (auto* agent : {&ua.os, &ua.browser}) {
+    f(agent->family);
+    f(agent->major);
+    f(agent->minor);
+    f(agent->patch);
+    f(agent->patch_minor);
+  }
+}
+
+}  // namespace
+
+void ServerProtocol::appendRequest(uint32_t id,
+                                   std::string_view ua,
+                                   std::string& out) {
+  append_uint(4 + ua.size(), 4, out);
+  append_uint(id, 4, out);
+  out.append(ua.data(), ua.size());
+}
+
+void ServerProtocol::appendResponse(uint32_t id,
+                                    const UserAgent& result,
+                                    std::string& out) {
+  // The frame size is written once the fields are
+  const size_t start = out.size();
+  out.append(4, '\0');
+  append_uint(id, 4, out);
+  append_uint((result.limits_hit.length ? 1 : 0) |
+                  (result.limits_hit.candidates ? 2 : 0) |
+                  (result.limits_hit.time ? 4 : 0),
+              1,
+              out);
+  for_each_field(result, [&](const std::string& field) {
+    const size_t size = std::min<size_t>(field.size(), 0xffff);
+    append_uint(size, 2, out);
+    out.append(field.data(), size);
+  });
+
+  const size_t payload_size = out.size() - start - 4;
+  for (size_t i = 0; i < 4; ++i) {
+    out[start + i] = static_cast<char>((payload_size >> (8 * i)) & 0xff);
+  }
+}
+
+bool ServerProtocol::nextFrame(std::string_view& buffer,
+                               std::string_view& payload) {
+  if (buffer.size() < 4) {
+    return false;
+  }
+  const size_t size = read_uint(buffer.data(), 4);
+  if (size > MAX_FRAME_SIZE) {
+    throw std::runtime_error("uap-server frame too large");
+  }
+  if (buffer.size() < 4 + size) {
+    return false;
+  }
+  payload = buffer.substr(4, size);
+  buffer.remove_prefix(4 + size);
+  return true;
+}
+
+bool ServerProtocol::decodeRequest(std::string_view payload,
+                                   uint32_t& id,
+                                   std::string_view& ua) {
+  if (payload.size() < 4) {
+    return false;
+  }
+  id = read_uint(payload.data(), 4);
+  ua = payload.substr(4);
+  return true;
+}
+
+bool ServerProtocol::decodeResponse(std::string_view payload,
+                                    uint32_t& id,
+                                    UserAgent& result) {
+  if (payload.size() < 5) {
+    return false;
+  }
+  id = read_uint(payload.data(), 4);
+  const uint64_t limits = read_uint(payload.data() + 4, 1);
+  result.limits_hit.length = limits & 1;
+  result.limits_hit.candidates = limits & 2;
+  result.limits_hit.time = limits & 4;
+  payload.remove_prefix(5);
+
+  bool valid = true;
+  for_each_field(result, [&](std::string& field) {
+    if (!valid || payload.size() < 2) {
+      valid = false;
+      return;
+    }
+    const size_t size = read_uint(payload.data(), 2);
+    if (payload.size() < 2 + size) {
+      valid = false;
+      return;
+    }
+    field.assign(payload.data() + 2, size);
+    payload.remove_prefix(2 + size);
+  });
+  return valid && payload.empty();
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "../UaParser"
+
+namespace uap_cpp {
+
+/**
+ * Binary protocol of uap-server. Every message is a frame: a payload size
+ * (4 bytes) followed by the payload. Integers are little-endian.
+ *
+ * Request payload: request id (4 bytes), then the user agent string.
+ *
+ * Response payload: the id of the request (4 bytes), the limits hit (1 byte:
+ * 1 for length, 2 for candidates, 4 for time), then the device family, brand
+ * and model, and the family, major, minor, patch and patch minor versions of
+ * the OS and then of the browser, each as a size (2 bytes) and its bytes.
+ *
+ * Responses come in request order on each connection, so clients may send
+ * several requests before reading the responses.
+ */
+class ServerProtocol {
+ public:
+  // Larger frames are a protocol error
+  static constexpr size_t MAX_FRAME_SIZE = 1 << 20;
+
+  static void appendRequest(uint32_t id, std::string_view ua, std::string& out);
+
+  /**
+   * Fields longer than 65535 bytes are truncated
+   */
+  static void appendResponse(uint32_t id,
+                             const UserAgent& result,
+                             std::string& out);
+
+  /**
+   * Takes the payload of the first frame from the front of buffer. Returns
+   * false if the frame is not complete yet. Throws std::runtime_error if the
+   * frame is larger than MAX_FRAME_SIZE.
+   */
+  static bool nextFrame(std::string_view& buffer, std::string_view& payload);
+
+  static bool decodeRequest(std::string_view payload,
+                            uint32_t& id,
+                            std::string_view& ua);
+
+  /**
+   * Assigns the result fields in place, except ua_string
+   */
+  static bool decodeResponse(std::string_view payload,
+                             uint32_t& id,
+                             UserAgent& result);
+};
+
+}  // namespace uap_cpp
@@ -0,0 +1,224 @@
+#include "SharedCache.h"
+
+#include "CompactResult.h"
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+#endif
+
+namespace uap_cpp {
+
+namespace {
+
+constexpr char MAGIC[8] = {'u', 'a', 'p', 'c', 'a', 'c', 'h', 'e'};
+constexpr uint32_t VERSION = 2;
+
+// Consecutive slots where an entry can be stored
+constexpr size_t PROBES = 4;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t slotSize;
+  uint64_t slotCount;
+  char padding[40];
+};
+static_assert(sizeof(Header) == 64, "the header fills a cache line");
+
+}  // namespace
+
+struct SharedCache::Slot {
+  // Odd while the slot is being written
+  std::atomic<uint32_t> sequence;
+  // Bytes of data in use, 0 for an empty slot
+  std::atomic<uint32_t> size;
+  std::atomic<uint64_t> hash;
+  char data[SLOT_SIZE - 16];
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "atomics in shared memory must be lock-free");
+
+#ifdef _WIN32
+
+SharedCache::SharedCache(const std::string&, size_t) {
+  throw std::runtime_error("The shared cache is not supported on Windows");
+}
+
+SharedCache::~SharedCache() {}
+
+#else
+
+namespace {
+
+/**
+ * Closes the file and releases its lock on every exit path
+ */
+struct FileLock {
+  explicit FileLock(int fd) : fd(fd) {}
+  ~FileLock() {
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+  }
+  int fd;
+};
+
+[[noreturn]] void throw_errno(const std::string& path) {
+  throw std::system_error(errno, std::generic_category(), path);
+}
+
+}  // namespace
+
+SharedCache::SharedCache(const std::string& path, size_t entries) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw_errno(path);
+  }
+  FileLock lock(fd);
+
+  // Creation is serialized, so that only one process sizes the file
+  if (::flock(fd, LOCK_EX) != 0) {
+    throw_errno(path);
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    throw_errno(path);
+  }
+
+  Header header;
+  if (st.st_size == 0) {
+    slotCount_ = PROBES;
+    while (slotCount_ < entries) {
+      slotCount_ <<= 1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.slotSize = SLOT_SIZE;
+    header.slotCount = slotCount_;
+
+    // The new slots read as zeros, i.e. empty
+    size_ = sizeof(Header) + slotCount_ * SLOT_SIZE;
+    if (::ftruncate(fd, size_) != 0 ||
+        ::pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      throw_errno(path);
+    }
+  } else {
+    if (::pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION || header.slotSize != SLOT_SIZE ||
+        header.slotCount < PROBES ||
+        (header.slotCount & (header.slotCount - 1)) != 0 ||
+        static_cast<uint64_t>(st.st_size) !=
+            sizeof(Header) + header.slotCount * SLOT_SIZE) {
+      throw std::runtime_error(path + " is not a compatible cache file");
+    }
+    slotCount_ = header.slotCount;
+    size_ = st.st_size;
+  }
+
+  data_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw_errno(path);
+  }
+  slots_ = reinterpret_cast<Slot*>(static_cast<char*>(data_) + sizeof(Header));
+}
+
+SharedCache::~SharedCache() {
+  if (data_) {
+    ::munmap(data_, size_);
+  }
+}
+
+#endif  // _WIN32
+
+SharedCache::Slot* SharedCache::slot(uint64_t hash, size_t probe) const {
+  static_assert(sizeof(Slot) == SLOT_SIZE, "slots have a fixed file layout");
+  return &slots_[(hash + probe) & (slotCount_ - 1)];
+}
+
+bool SharedCache::find(std::string_view ua,
+                       uint64_t hash,
+                       UserAgent& result) const {
+  // Empty slots have a zero hash
+  hash |= 1;
+
+  thread_local char buffer[sizeof(Slot::data)];
+  for (size_t probe = 0; probe < PROBES; ++probe) {
+    const Slot& s = *slot(hash, probe);
+
+    const uint32_t sequence = s.sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) || s.hash.load(std::memory_order_relaxed) != hash) {
+      continue;
+    }
+    const uint32_t size = s.size.load(std::memory_order_relaxed);
+    if (size > sizeof(buffer)) {
+      continue;
+    }
+    // The copy may race with a writer, in which case the sequence changes
+    // and the copy is discarded
+    memcpy(buffer, s.data, size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s.sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+
+    if (CompactResult::decode(std::string_view(buffer, size), ua, result)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SharedCache::insert(std::string_view ua,
+                         uint64_t hash,
+                         const UserAgent& result) {
+  hash |= 1;
+
+  const size_t size = CompactResult::encodedSize(ua, result);
+  if (!size || size > sizeof(Slot::data)) {
+    return;
+  }
+
+  // Reuse the slot of the same hash or an empty one, else evict the slot
+  // picked by the upper bits of the hash
+  Slot* target = slot(hash, (hash >> 60) % PROBES);
+  for (size_t probe = 0; probe < PROBES; ++probe) {
+    Slot* s = slot(hash, probe);
+    const uint64_t slot_hash = s->hash.load(std::memory_order_relaxed);
+    if (slot_hash == hash || slot_hash == 0) {
+      target = s;
+      break;
+    }
+  }
+
+  uint32_t sequence = target->sequence.load(std::memory_order_relaxed);
+  if ((sequence & 1) ||
+      !target->sequence.compare_exchange_strong(
+          sequence, sequence + 1, std::memory_order_relaxed)) {
+    // Someone else is writing this slot
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+
+  target->hash.store(hash, std::memory_order_relaxed);
+  target->size.store(size, std::memory_order_relaxed);
+  CompactResult::encode(ua, result, target->data);
+
+  target->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "../UaParser"
+
+namespace uap_cpp {
+
+/**
+ * Cache of parse results in a memory-mapped file, shared by every process
+ * (and thread) that opens the same file.
+ *
+ * The file holds an open-addressing table of fixed-size slots, each guarded
+ * by a sequence lock: a writer makes the sequence odd while it updates a
+ * slot, and readers retry nothing, they just treat a slot that is being
+ * written or changed under them as a miss. Writers never wait either, a slot
+ * that is being written by someone else is left alone. Entries that do not
+ * fit in a slot are not cached.
+ *
+ * A slot whose writer died in the middle of an update stays unusable until
+ * the file is recreated.
+ *
+ * POSIX only; the constructor throws elsewhere.
+ */
+class SharedCache {
+ public:
+  static constexpr size_t SLOT_SIZE = 512;
+
+  /**
+   * Opens the cache file, creating it with room for at least entries
+   * entries if it does not exist. An existing file keeps its size. Throws
+   * std::system_error if the file cannot be created or mapped, and
+   * std::runtime_error if it is not a cache file.
+   */
+  SharedCache(const std::string& path, size_t entries);
+  ~SharedCache();
+
+  SharedCache(const SharedCache&) = delete;
+  SharedCache& operator=(const SharedCache&) = delete;
+
+  /**
+   * hash is the hash of ua; it must also cover anything else the result
+   * depends on, such as the rules
+   */
+  bool find(std::string_view ua, uint64_t hash, UserAgent& result) const;
+  void insert(std::string_view ua, uint64_t hash, const UserAgent& result);
+
+  size_t slotCount() const { return slotCount_; }
+  size_t mappedBytes() const { return size_; }
+
+ private:
+  struct Slot;
+
+  Slot* slot(uint64_t hash, size_t probe) const;
+
+  void* data_{nullptr};
+  size_t size_{0};
+  Slot* slots_{nullptr};
+  size_t slotCount_{0};
+};
+
+}  // namespace uap_cpp
@@ -1,7 +1,10 @@
 #include "SnippetIndex.h"
 
+#include "MemoryUsage.h"
 #include "StringUtils.h"
 
+#include <algorithm>
+
 namespace uap_cpp {
 
 namespace {
@@ -87,6 +90,23 @@ inline uint8_t to_byte(char c, bool to_lowercase = true) {
 
 }  // namespace
 
+SnippetIndex::NodeId SnippetIndex::child(NodeId parent, uint8_t byte) {
+  for (NodeId node = buildNodes_[parent].firstChild_; node;
+       node = buildNodes_[node].nextSibling_) {
+    if (buildNodes_[node].byte_ == byte) {
+      return node;
+    }
+  }
+
+  NodeId node = buildNodes_.size();
+  buildNodes_.emplace_back();
+  buildNodes_[node].parent_ = parent;
+  buildNodes_[node].byte_ = byte;
+  buildNodes_[node].nextSibling_ = buildNodes_[parent].firstChild_;
+  buildNodes_[parent].firstChild_ = node;
+  return node;
+}
+
 SnippetIndex::SnippetSet SnippetIndex::registerSnippets(
     const StringView& expression) {
   SnippetSet out;
@@ -98,35 +118,30 @@ SnippetIndex::SnippetSet SnippetIndex::registerSnippets(
 
   const char* s = expression.start();
   const char* snippet_start = nullptr;
-  TrieNode* node = nullptr;
+  // Node 0 is the root, so there is no current snippet when snippet_start is
+  // null
+  NodeId node = 0;
 
   bool prev_was_backslash = false;
   while (!expression.isEnd(s)) {
     if (is_snippet_char(*s, prev_was_backslash)) {
-      if (!node) {
+      if (!snippet_start) {
         snippet_start = s;
-        node = &trieRootNode_;
-      }
-
-      TrieNode*& next_node = node->transitions_[to_byte(*s)];
-      if (!next_node) {
-        next_node = new TrieNode;
-        next_node->parent_ = node;
+        node = 0;
       }
-      node = next_node;
+      node = child(node, to_byte(*s));
     } else {
-      if (node) {
+      if (snippet_start) {
         const char* snippet_end = s;
         if (is_optional_operator(expression.from(snippet_end))) {
           // Do not include optional characters  a? a*
           --snippet_end;
-          node = node->parent_;
+          node = buildNodes_[node].parent_;
         }
 
         registerSnippet(snippet_start, snippet_end, node, out);
 
         snippet_start = nullptr;
-        node = nullptr;
       }
     }
 
@@ -138,7 +153,7 @@ SnippetIndex::SnippetSet SnippetIndex::registerSnippets(
     ++s;
   }
 
-  if (node) {
+  if (snippet_start) {
     registerSnippet(snippet_start, s, node, out);
   }
 
@@ -147,36 +162,124 @@ SnippetIndex::SnippetSet SnippetIndex::registerSnippets(
 
 void SnippetIndex::registerSnippet(const char* start,
                                    const char* end,
-                                   TrieNode* node,
+                                   NodeId node,
                                    SnippetIndex::SnippetSet& out) {
-  if (node && end - start > 2) {
-    if (!node->snippetId_) {
-      node->snippetId_ = ++maxSnippetId_;
+  if (end - start > 2) {
+    auto& snippet_id = buildNodes_[node].snippetId_;
+    if (!snippet_id) {
+      std::string text;
+      for (NodeId n = node; n; n = buildNodes_[n].parent_) {
+        text.insert(text.begin(), static_cast<char>(buildNodes_[n].byte_));
+      }
+      snippets_.push_back(std::move(text));
+      snippet_id = snippets_.size();
     }
-    out.insert(node->snippetId_);
+    out.insert(snippet_id);
   }
 }
 
-SnippetIndex::TrieNode::~TrieNode() {
-  for (auto* node : transitions_) {
-    delete node;
+void SnippetIndex::freeze() {
+  if (frozen_) {
+    return;
+  }
+
+  // Bytes used in the trie get their own class, uppercase letters share the
+  // class of their lowercase letter
+  classCount_ = 1;
+  for (size_t i = 1; i < buildNodes_.size(); ++i) {
+    const uint8_t byte = buildNodes_[i].byte_;
+    if (!byteClasses_[byte]) {
+      byteClasses_[byte] = classCount_++;
+    }
+  }
+  for (int c = 'A'; c <= 'Z'; ++c) {
+    byteClasses_[c] = byteClasses_[c | 0x20];
+  }
+
+  // Number the nodes breadth-first, so that the first levels, which every
+  // input byte goes through, are next to each other
+  std::vector<NodeId> order(1, 0);
+  std::vector<NodeId> frozenIds(buildNodes_.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    frozenIds[order[i]] = i + 1;
+    for (NodeId c = buildNodes_[order[i]].firstChild_; c;
+         c = buildNodes_[c].nextSibling_) {
+      order.push_back(c);
+    }
+  }
+
+  nodeCount_ = order.size() + 1;
+  ownedTransitions_.assign(nodeCount_ * classCount_, 0);
+  ownedSnippetIds_.assign(nodeCount_, 0);
+  for (NodeId node : order) {
+    const NodeId row = frozenIds[node];
+    ownedSnippetIds_[row] = buildNodes_[node].snippetId_;
+    for (NodeId c = buildNodes_[node].firstChild_; c;
+         c = buildNodes_[c].nextSibling_) {
+      ownedTransitions_[row * classCount_ +
+                        byteClasses_[buildNodes_[c].byte_]] = frozenIds[c];
+    }
   }
+  transitions_ = ownedTransitions_.data();
+  snippetIds_ = ownedSnippetIds_.data();
+
+  std::vector<BuildNode>().swap(buildNodes_);
+  frozen_ = true;
+}
+
+void SnippetIndex::freeze(const Tables& tables) {
+  std::copy(tables.byteClasses, tables.byteClasses + 256, byteClasses_);
+  classCount_ = tables.classCount;
+  transitions_ = tables.transitions;
+  snippetIds_ = tables.snippetIds;
+  nodeCount_ = tables.nodeCount;
+  snippets_.assign(tables.snippets, tables.snippets + tables.snippetCount);
+
+  std::vector<BuildNode>().swap(buildNodes_);
+  frozen_ = true;
+}
+
+SnippetIndex::Tables SnippetIndex::tables() const {
+  return {byteClasses_,
+          classCount_,
+          transitions_,
+          snippetIds_,
+          nodeCount_,
+          nullptr,
+          0};
+}
+
+size_t SnippetIndex::memoryUsage() const {
+  size_t bytes = vector_heap_bytes(buildNodes_) + vector_heap_bytes(snippets_);
+  if (ownedTransitions_.empty()) {
+    bytes += nodeCount_ * (classCount_ * sizeof(NodeId) + sizeof(SnippetId));
+  } else {
+    bytes += vector_heap_bytes(ownedTransitions_) +
+             vector_heap_bytes(ownedSnippetIds_);
+  }
+  return bytes;
 }
 
 SnippetIndex::SnippetSet SnippetIndex::getSnippets(
     const StringView& text) const {
   SnippetSet out;
+  if (!frozen_) {
+    return out;
+  }
 
+  const NodeId* transitions = transitions_;
+  const SnippetId* snippet_ids = snippetIds_;
   const char* snippet_start = text.start();
   while (!text.isEnd(snippet_start)) {
     const char* snippet_end = snippet_start;
-    const TrieNode* node = &trieRootNode_;
+    NodeId node = 1;
     while (node && !text.isEnd(snippet_end)) {
       // Every character can be the start of a snippet (actually, only snippet
-      // characters, but unconditionally looking it up in the array is faster)
-      node = node->transitions_[to_byte(*snippet_end)];
-      if (node && node->snippetId_) {
-        out.insert(node->snippetId_);
+      // characters, but unconditionally looking it up in the table is faster)
+      node = transitions[node * classCount_ +
+                         byteClasses_[static_cast<uint8_t>(*snippet_end)]];
+      if (snippet_ids[node]) {
+        out.insert(snippet_ids[node]);
       }
       ++snippet_end;
     }
@@ -186,28 +289,12 @@ SnippetIndex::SnippetSet SnippetIndex::getSnippets(
   return out;
 }
 
-namespace {
-template <class TrieNode, class Map>
-void build_map(const TrieNode& node, const std::string& base_string, Map& map) {
-  if (node.snippetId_) {
-    map.insert(std::make_pair(node.snippetId_, base_string));
-  }
-
-  for (int i = 0; i < 256; i++) {
-    auto* next_node = node.transitions_[i];
-    if (next_node) {
-      std::string next_string(base_string);
-      next_string += static_cast<char>(i);
-      build_map(*next_node, next_string, map);
-    }
-  }
-}
-}  // namespace
-
 std::unordered_map<SnippetIndex::SnippetId, std::string>
 SnippetIndex::getRegisteredSnippets() const {
   std::unordered_map<SnippetId, std::string> map;
-  build_map(trieRootNode_, "", map);
+  for (size_t i = 0; i < snippets_.size(); ++i) {
+    map.insert(std::make_pair(i + 1, snippets_[i]));
+  }
   return map;
 }
 
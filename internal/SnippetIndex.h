@@ -2,6 +2,7 @@
 
 #include "StringView.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <set>
 #include <string>
@@ -17,30 +18,88 @@ namespace uap_cpp {
  * input string for the expression to match ("a" is optional, however). This
  * class handles indexing snippets in expressions, and quickly returning which
  * snippets are present in an input string.
+ *
+ * Snippets are registered into a trie whose nodes are kept in one vector and
+ * linked by position. freeze() then compacts it into a transition table with
+ * one row per node, in breadth-first order, and one column per byte class
+ * (the bytes that occur in snippets, case folded). getSnippets() needs a
+ * frozen index; no snippets can be registered after freezing.
+ *
+ * The frozen tables can also be generated ahead of time and loaded from
+ * constant data, which is then used in place.
  */
 class SnippetIndex {
  public:
   typedef uint32_t SnippetId;
+  typedef uint32_t NodeId;
   typedef std::set<SnippetId> SnippetSet;
 
+  struct Tables {
+    const uint8_t* byteClasses;  // 256 entries
+    size_t classCount;
+    // nodeCount rows of classCount entries
+    const NodeId* transitions;
+    const SnippetId* snippetIds;
+    size_t nodeCount;
+    // Text of every snippet, by id - 1
+    const char* const* snippets;
+    size_t snippetCount;
+  };
+
+  SnippetIndex() = default;
+  SnippetIndex(const SnippetIndex&) = delete;
+  SnippetIndex& operator=(const SnippetIndex&) = delete;
+
   SnippetSet registerSnippets(const StringView& expression);
+  void freeze();
+
+  /**
+   * Uses frozen tables, which must outlive the index
+   */
+  void freeze(const Tables&);
+
+  /**
+   * Tables of a frozen index; the snippets field is left empty
+   */
+  Tables tables() const;
+
   SnippetSet getSnippets(const StringView& text) const;
 
   std::unordered_map<SnippetId, std::string> getRegisteredSnippets() const;
 
+  /**
+   * Bytes of the tables and snippet texts, including constant tables used in
+   * place, excluding the object itself
+   */
+  size_t memoryUsage() const;
+
  private:
-  struct TrieNode {
-    ~TrieNode();
-    TrieNode* transitions_[256]{nullptr};
-    TrieNode* parent_{nullptr};
+  // Trie node while registering, linked to its first child and next sibling
+  struct BuildNode {
+    NodeId parent_{0};
+    NodeId firstChild_{0};
+    NodeId nextSibling_{0};
     SnippetId snippetId_{0};
+    uint8_t byte_{0};
   };
-  TrieNode trieRootNode_;
-  SnippetId maxSnippetId_{0};
+  std::vector<BuildNode> buildNodes_{1};
+
+  // Frozen trie: row 0 is a dead end, row 1 the root
+  uint8_t byteClasses_[256]{0};
+  size_t classCount_{0};
+  const NodeId* transitions_{nullptr};
+  const SnippetId* snippetIds_{nullptr};
+  size_t nodeCount_{0};
+  std::vector<NodeId> ownedTransitions_;
+  std::vector<SnippetId> ownedSnippetIds_;
+  bool frozen_{false};
+
+  std::vector<std::string> snippets_;
 
+  NodeId child(NodeId, uint8_t byte);
   void registerSnippet(const char* start,
                        const char* end,
-                       TrieNode*,
+                       NodeId,
                        SnippetSet&);
 };
 
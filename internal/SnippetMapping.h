@@ -1,37 +1,164 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
-#include <memory>
 #include <unordered_map>
-#include <unordered_set>
-
-#include "MakeUnique.h"
+#include <utility>
+#include <vector>
 
 namespace uap_cpp {
 
+/**
+ * Node of a frozen SnippetMapping, owning a range of its transition and
+ * expression arrays
+ */
+struct SnippetMappingNode {
+  uint32_t firstTransition;
+  uint32_t lastTransition;
+  uint32_t firstExpression;
+  uint32_t lastExpression;
+};
+
+struct SnippetMappingTables {
+  const SnippetMappingNode* nodes;
+  size_t nodeCount;
+  // Transitions sorted by snippet within each node
+  const uint32_t* transitionSnippets;
+  const uint32_t* transitionTargets;
+  size_t transitionCount;
+};
+
 /**
  * Maps a set of snippets to a set of expressions.
+ *
+ * Mappings are added to a trie keyed by snippet. freeze() then lays the trie
+ * out in flat arrays, in breadth-first order: the nodes, their transitions
+ * sorted by snippet, and their expressions. getExpressions() needs a frozen
+ * mapping; no mappings can be added after freezing.
+ *
+ * The frozen tables can also be generated ahead of time and loaded from
+ * constant data, which is then used in place.
  */
 template <class Expression>
 class SnippetMapping {
  public:
   typedef uint32_t SnippetId;
 
+  SnippetMapping() = default;
+  SnippetMapping(const SnippetMapping&) = delete;
+  SnippetMapping& operator=(const SnippetMapping&) = delete;
+
   /**
    * Add an expression to the mapping. The snippets all need to be present
    * for an expression to match. The snippets need to be ordered.
    */
   template <class SnippetSet>
   void addMapping(const SnippetSet& snippets, const Expression& expression) {
-    TrieNode* node = &trieRootNode_;
+    NodeId node = 0;
     for (SnippetId snippet : snippets) {
-      auto& slot = node->transitions_[snippet];
-      if (!slot) {
-        slot = uap_cpp::make_unique<TrieNode>();
+      auto inserted = buildTransitions_.emplace(
+          transitionKey(node, snippet), buildNodeCount_);
+      if (inserted.second) {
+        ++buildNodeCount_;
+      }
+      node = inserted.first->second;
+    }
+    buildExpressions_.emplace_back(node, expression);
+  }
+
+  void freeze() {
+    if (frozen_) {
+      return;
+    }
+
+    std::vector<std::vector<std::pair<SnippetId, NodeId>>> children(
+        buildNodeCount_);
+    for (const auto& transition : buildTransitions_) {
+      children[transition.first >> 32].emplace_back(
+          static_cast<SnippetId>(transition.first), transition.second);
+    }
+    std::vector<std::vector<Expression>> expressions(buildNodeCount_);
+    for (const auto& entry : buildExpressions_) {
+      auto& list = expressions[entry.first];
+      if (std::find(list.begin(), list.end(), entry.second) == list.end()) {
+        list.push_back(entry.second);
       }
-      node = slot.get();
     }
-    node->expressions_.insert(expression);
+
+    std::vector<NodeId> order(1, 0);
+    std::vector<NodeId> frozenIds(buildNodeCount_);
+    for (size_t i = 0; i < order.size(); ++i) {
+      frozenIds[order[i]] = i;
+      auto& node_children = children[order[i]];
+      std::sort(node_children.begin(), node_children.end());
+      for (const auto& child : node_children) {
+        order.push_back(child.second);
+      }
+    }
+
+    ownedNodes_.resize(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      SnippetMappingNode& node = ownedNodes_[i];
+      node.firstTransition = ownedTransitionSnippets_.size();
+      for (const auto& child : children[order[i]]) {
+        ownedTransitionSnippets_.push_back(child.first);
+        ownedTransitionTargets_.push_back(frozenIds[child.second]);
+      }
+      node.lastTransition = ownedTransitionSnippets_.size();
+
+      node.firstExpression = expressions_.size();
+      const auto& node_expressions = expressions[order[i]];
+      expressions_.insert(
+          expressions_.end(), node_expressions.begin(), node_expressions.end());
+      node.lastExpression = expressions_.size();
+    }
+
+    tables_ = {ownedNodes_.data(),
+               ownedNodes_.size(),
+               ownedTransitionSnippets_.data(),
+               ownedTransitionTargets_.data(),
+               ownedTransitionSnippets_.size()};
+    clearBuildState();
+  }
+
+  /**
+   * Uses frozen tables, which must outlive the mapping. The expressions of
+   * the nodes are given as ids, converted with toExpression.
+   */
+  template <class ToExpression>
+  void freeze(const SnippetMappingTables& tables,
+              const uint32_t* expressionIds,
+              size_t expressionCount,
+              const ToExpression& toExpression) {
+    tables_ = tables;
+    expressions_.clear();
+    expressions_.reserve(expressionCount);
+    for (size_t i = 0; i < expressionCount; ++i) {
+      expressions_.push_back(toExpression(expressionIds[i]));
+    }
+    clearBuildState();
+  }
+
+  const SnippetMappingTables& tables() const { return tables_; }
+
+  /**
+   * Expressions of all nodes of a frozen mapping, in node order
+   */
+  const std::vector<Expression>& expressions() const { return expressions_; }
+
+  /**
+   * Bytes of the tables, including constant tables used in place, excluding
+   * the object itself and the expressions pointed to
+   */
+  size_t memoryUsage() const {
+    size_t bytes = tables_.nodeCount * sizeof(SnippetMappingNode) +
+                   tables_.transitionCount * 2 * sizeof(uint32_t) +
+                   expressions_.capacity() * sizeof(Expression) +
+                   buildExpressions_.capacity() * sizeof(buildExpressions_[0]);
+    // Approximately one node and one bucket per entry
+    bytes += buildTransitions_.size() * (sizeof(uint64_t) + 3 * sizeof(void*));
+    return bytes;
   }
 
   /**
@@ -41,33 +168,64 @@ class SnippetMapping {
    */
   template <class SnippetSet, class Result>
   void getExpressions(const SnippetSet& snippets, Result& expressions) const {
-    auto end = snippets.end();
+    if (!tables_.nodeCount) {
+      return;
+    }
     getExpressionsRecursively(
-        snippets.begin(), end, trieRootNode_, expressions);
+        snippets.begin(), snippets.end(), 0, expressions);
   }
 
  private:
-  struct TrieNode {
-    std::unordered_map<SnippetId, std::unique_ptr<TrieNode>> transitions_;
-    std::unordered_set<Expression> expressions_;
-  };
-  TrieNode trieRootNode_;
+  typedef uint32_t NodeId;
+
+  static uint64_t transitionKey(NodeId node, SnippetId snippet) {
+    return (static_cast<uint64_t>(node) << 32) | snippet;
+  }
+
+  // Trie while adding mappings: node 0 is the root
+  std::unordered_map<uint64_t, NodeId> buildTransitions_;
+  std::vector<std::pair<NodeId, Expression>> buildExpressions_;
+  NodeId buildNodeCount_{1};
+
+  // Frozen trie, in ownedNodes_ etc. unless loaded from constant tables
+  SnippetMappingTables tables_{nullptr, 0, nullptr, nullptr, 0};
+  std::vector<SnippetMappingNode> ownedNodes_;
+  std::vector<SnippetId> ownedTransitionSnippets_;
+  std::vector<NodeId> ownedTransitionTargets_;
+  std::vector<Expression> expressions_;
+  bool frozen_{false};
+
+  void clearBuildState() {
+    std::unordered_map<uint64_t, NodeId>().swap(buildTransitions_);
+    std::vector<std::pair<NodeId, Expression>>().swap(buildExpressions_);
+    frozen_ = true;
+  }
 
   template <class Iterator, class Result>
   void getExpressionsRecursively(Iterator it,
                                  const Iterator& end,
-                                 const TrieNode& node,
+                                 NodeId nodeId,
                                  Result& expressions) const {
-    if (!node.expressions_.empty()) {
-      expressions.insert(node.expressions_.begin(), node.expressions_.end());
+    const SnippetMappingNode& node = tables_.nodes[nodeId];
+    if (node.firstExpression != node.lastExpression) {
+      expressions.insert(expressions_.begin() + node.firstExpression,
+                         expressions_.begin() + node.lastExpression);
     }
 
-    while (it != end) {
-      auto findIt = node.transitions_.find(*it);
-      ++it;
-
-      if (findIt != node.transitions_.end()) {
-        getExpressionsRecursively(it, end, *findIt->second, expressions);
+    // Both the snippets and the transitions are sorted, so they are
+    // intersected in a single pass
+    uint32_t transition = node.firstTransition;
+    while (it != end && transition != node.lastTransition) {
+      const SnippetId snippet = tables_.transitionSnippets[transition];
+      if (snippet < *it) {
+        ++transition;
+      } else if (*it < snippet) {
+        ++it;
+      } else {
+        ++it;
+        getExpressionsRecursively(
+            it, end, tables_.transitionTargets[transition], expressions);
+        ++transition;
       }
     }
   }
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../UaParser"
+
+#ifdef UAP_CPP_STAGE_HOOKS
+#include <chrono>
+#endif
+
+namespace uap_cpp {
+
+/**
+ * Reports the time between consecutive laps to a StageHook.
+ *
+ * Without UAP_CPP_STAGE_HOOKS this is an empty class whose calls compile to
+ * nothing.
+ */
+#ifdef UAP_CPP_STAGE_HOOKS
+class StageTimer {
+ public:
+  StageTimer(StageHook* hook, Category category)
+      : hook_(hook), category_(category) {
+    if (hook_) {
+      last_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  void lap(Stage stage) {
+    if (hook_) {
+      auto now = std::chrono::steady_clock::now();
+      hook_->on_stage(
+          category_,
+          stage,
+          std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_)
+              .count());
+      last_ = now;
+    }
+  }
+
+ private:
+  StageHook* hook_;
+  Category category_;
+  std::chrono::steady_clock::time_point last_;
+};
+#else
+class StageTimer {
+ public:
+  StageTimer(StageHook*, Category) {}
+  void lap(Stage) {}
+};
+#endif
+
+}  // namespace uap_cpp
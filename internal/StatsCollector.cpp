@@ -0,0 +1,64 @@
+#include "StatsCollector.h"
+
+#include <unordered_map>
+
+namespace uap_cpp {
+
+namespace {
+
+// Collector ids are never reused, so a thread's cached counters can not be
+// mistaken for those of a newer collector at the same address
+std::atomic<uint64_t> next_collector_id{1};
+
+}  // namespace
+
+StatsCollector::StatsCollector(const std::vector<size_t>& rulesPerCategory)
+    : id_(next_collector_id.fetch_add(1)),
+      rulesPerCategory_(rulesPerCategory) {}
+
+StatsCollector::ThreadCounters& StatsCollector::local() {
+  thread_local uint64_t last_id = 0;
+  thread_local ThreadCounters* last_counters = nullptr;
+  if (last_id == id_) {
+    return *last_counters;
+  }
+
+  thread_local std::unordered_map<uint64_t, ThreadCounters*> counters_by_id;
+  ThreadCounters*& counters = counters_by_id[id_];
+  if (!counters) {
+    std::unique_ptr<ThreadCounters> created(new ThreadCounters);
+    for (size_t i = 0; i < CATEGORIES; ++i) {
+      created->categories[i].rules.reset(
+          new RuleCounters[rulesPerCategory_[i]]);
+    }
+    counters = created.get();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.emplace_back(std::move(created));
+  }
+
+  last_id = id_;
+  last_counters = counters;
+  return *counters;
+}
+
+size_t StatsCollector::histogramBucket(size_t candidates) {
+  size_t bucket = 0;
+  while (candidates > 0 && bucket + 1 < HISTOGRAM_BUCKETS) {
+    candidates >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+size_t StatsCollector::memoryUsage() const {
+  size_t perThread = sizeof(ThreadCounters);
+  for (size_t rules : rulesPerCategory_) {
+    perThread += rules * sizeof(RuleCounters);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return threads_.capacity() * sizeof(threads_[0]) +
+         threads_.size() * perThread;
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace uap_cpp {
+
+/**
+ * Per-rule and per-category parse counters, kept per thread and summed on
+ * read.
+ *
+ * Every thread only writes to its own counters, so updates are plain relaxed
+ * loads and stores without read-modify-write instructions or contention.
+ * Counters of threads that have exited are kept until the collector is
+ * destroyed.
+ */
+class StatsCollector {
+ public:
+  static constexpr size_t CATEGORIES = 3;
+  static constexpr size_t HISTOGRAM_BUCKETS = 12;
+
+  struct RuleCounters {
+    std::atomic<uint64_t> candidates{0};
+    std::atomic<uint64_t> evaluations{0};
+    std::atomic<uint64_t> matches{0};
+    std::atomic<uint64_t> matchNanoseconds{0};
+  };
+
+  struct CategoryCounters {
+    std::atomic<uint64_t> parses{0};
+    std::atomic<uint64_t> noMatch{0};
+    std::atomic<uint64_t> candidateHistogram[HISTOGRAM_BUCKETS]{};
+    std::unique_ptr<RuleCounters[]> rules;
+  };
+
+  struct ThreadCounters {
+    CategoryCounters categories[CATEGORIES];
+    std::atomic<uint64_t> sharedCacheHits{0};
+    std::atomic<uint64_t> sharedCacheMisses{0};
+    std::atomic<uint64_t> warmCacheHits{0};
+    std::atomic<uint64_t> warmCacheMisses{0};
+  };
+
+  explicit StatsCollector(const std::vector<size_t>& rulesPerCategory);
+
+  /**
+   * Counters of the calling thread, created on first use
+   */
+  ThreadCounters& local();
+
+  /**
+   * Calls f with the counters of every thread that has used the collector
+   */
+  template <class F>
+  void forEachThread(const F& f) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& counters : threads_) {
+      f(static_cast<const ThreadCounters&>(*counters));
+    }
+  }
+
+  /**
+   * Histogram bucket of a candidate count: 0 for none, then powers of two
+   */
+  static size_t histogramBucket(size_t candidates);
+
+  /**
+   * Bytes of the counters of all threads
+   */
+  size_t memoryUsage() const;
+
+  static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  static uint64_t get(const std::atomic<uint64_t>& counter) {
+    return counter.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const uint64_t id_;
+  const std::vector<size_t> rulesPerCategory_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadCounters>> threads_;
+};
+
+}  // namespace uap_cpp
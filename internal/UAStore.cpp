@@ -0,0 +1,251 @@
+#include "UAStore.h"
+
+#include <algorithm>
+#include <bit>
+#include <string_view>
+
+#include "AlternativeExpander.h"
+#include "Hash.h"
+#include "RuleSubset.h"
+
+namespace uap_cpp {
+
+namespace {
+
+typedef std::optional<std::string> Replacement;
+
+void assign(ReplaceTemplate& replace_template, const Replacement& value) {
+  if (value) {
+    replace_template = *value;
+  }
+}
+
+void assign(DeviceStore& device,
+            const std::string& regex,
+            bool case_insensitive,
+            const Replacement* replacements,
+            const PatternOptions& options) {
+  device.regExpr.assign(regex, !case_insensitive, options);
+  assign(device.replacement, replacements[0]);
+  assign(device.brandReplacement, replacements[1]);
+  assign(device.modelReplacement, replacements[2]);
+}
+
+void assign(AgentStore& agent,
+            const std::string& regex,
+            bool,
+            const Replacement* replacements,
+            const PatternOptions& options) {
+  agent.regExpr.assign(regex, true, options);
+  assign(agent.replacement, replacements[0]);
+  assign(agent.majorVersionReplacement, replacements[1]);
+  assign(agent.minorVersionReplacement, replacements[2]);
+  assign(agent.patchVersionReplacement, replacements[3]);
+}
+
+/**
+ * Mixes a rule into the fingerprint. Every string is hashed separately, with
+ * its length, so that moving text between fields changes the fingerprint.
+ */
+void add_fingerprint(uint64_t& fingerprint,
+                     const std::string& regex,
+                     bool case_insensitive,
+                     const Replacement* replacements) {
+  fingerprint = hash64(regex, fingerprint ^ case_insensitive);
+  for (int r = 0; r < 4; ++r) {
+    fingerprint = replacements[r] ? hash64(*replacements[r], fingerprint + r)
+                                  : hash64({}, ~fingerprint);
+  }
+}
+
+/**
+ * Mixes in the start of a category and its size, so that moving a rule to
+ * another category changes the fingerprint
+ */
+void add_fingerprint(uint64_t& fingerprint,
+                     std::string_view category,
+                     size_t rule_count) {
+  fingerprint = hash64(category, fingerprint + rule_count);
+}
+
+/**
+ * Mixes in the options that change results for the same rules
+ */
+void add_fingerprint(uint64_t& fingerprint, const PatternOptions& options) {
+  if (options.longestMatch) {
+    fingerprint = hash64("longest_match", fingerprint);
+  }
+}
+
+PatternOptions pattern_options(const ParserOptions& options,
+                               size_t rule_count) {
+  PatternOptions pattern;
+  pattern.maxMemory = options.regex_max_memory;
+  pattern.maxMemoryCap = options.regex_max_memory;
+  if (options.regex_total_memory && rule_count) {
+    // Rounded down to a power of two, so that rule sets of other sizes get
+    // the same budgets and share compiled regexes. re2 takes budgets of a
+    // byte or two as no budget at all.
+    const int64_t share = std::max<int64_t>(
+        std::bit_floor(static_cast<uint64_t>(options.regex_total_memory) /
+                       rule_count),
+        1024);
+    pattern.maxMemory = std::min(
+        share,
+        pattern.maxMemory ? pattern.maxMemory : re2::RE2::Options().max_mem());
+  }
+  pattern.longestMatch = options.longest_match;
+  pattern.literalFastPath = options.literal_fast_path;
+  return pattern;
+}
+
+template <class Store>
+void fill_stores(const std::vector<RuleDefinition>& rules,
+                 std::vector<Store>& stores,
+                 SnippetIndex& snippet_index,
+                 SnippetMapping<const Store*>& mapping,
+                 const PatternOptions& options,
+                 uint64_t& fingerprint) {
+  // Stores are reserved up front, so they do not move as mappings to them are
+  // added
+  stores.reserve(rules.size());
+  for (const auto& rule : rules) {
+    stores.emplace_back();
+    Store& store = stores.back();
+    store.index = stores.size();
+    assign(
+        store, rule.regex, rule.caseInsensitive, rule.replacements, options);
+    add_fingerprint(
+        fingerprint, rule.regex, rule.caseInsensitive, rule.replacements);
+
+    for (const auto& e : AlternativeExpander::expand(rule.regex)) {
+      auto snippets = snippet_index.registerSnippets(e);
+      mapping.addMapping(snippets, &store);
+    }
+  }
+
+  snippet_index.freeze();
+  mapping.freeze();
+}
+
+template <class Store>
+void fill_stores(const BuiltinCategory& category,
+                 std::vector<Store>& stores,
+                 SnippetIndex& snippet_index,
+                 SnippetMapping<const Store*>& mapping,
+                 const PatternOptions& options,
+                 uint64_t& fingerprint) {
+  stores.reserve(category.ruleCount);
+  for (size_t i = 0; i < category.ruleCount; ++i) {
+    const auto& rule = category.rules[i];
+    Replacement replacements[4];
+    for (int r = 0; r < 4; ++r) {
+      if (rule.replacements[r]) {
+        replacements[r] = rule.replacements[r];
+      }
+    }
+    stores.emplace_back();
+    stores.back().index = stores.size();
+    assign(stores.back(),
+           rule.regex,
+           rule.caseInsensitive,
+           replacements,
+           options);
+    add_fingerprint(
+        fingerprint, rule.regex, rule.caseInsensitive, replacements);
+  }
+
+  snippet_index.freeze(category.index);
+  mapping.freeze(category.mapping,
+                 category.mappingRules,
+                 category.mappingRuleCount,
+                 [&](uint32_t rule) { return &stores[rule]; });
+}
+
+void add_definitions(const BuiltinCategory& category,
+                     std::vector<RuleDefinition>& definitions) {
+  for (size_t i = 0; i < category.ruleCount; ++i) {
+    const auto& rule = category.rules[i];
+    definitions.emplace_back();
+    definitions.back().regex = rule.regex;
+    definitions.back().caseInsensitive = rule.caseInsensitive;
+    for (int r = 0; r < 4; ++r) {
+      if (rule.replacements[r]) {
+        definitions.back().replacements[r] = rule.replacements[r];
+      }
+    }
+  }
+}
+
+}  // namespace
+
+UAStore::UAStore(const std::string& regexes_file_path,
+                 const ParserOptions& options)
+    : UAStore(RuleDefinitions::load(regexes_file_path), options) {}
+
+UAStore::UAStore(const RuleDefinitions& rules, const ParserOptions& options) {
+  if (RuleSubset::active(options)) {
+    load(RuleSubset::select(rules, options), options);
+  } else {
+    load(rules, options);
+  }
+}
+
+UAStore::UAStore(const BuiltinRules& rules, const ParserOptions& options) {
+  if (RuleSubset::active(options)) {
+    // The generated indexes cover all rules
+    RuleDefinitions definitions;
+    add_definitions(rules.device, definitions.device);
+    add_definitions(rules.os, definitions.os);
+    add_definitions(rules.browser, definitions.browser);
+    load(RuleSubset::select(definitions, options), options);
+    return;
+  }
+
+  const auto pattern = pattern_options(
+      options,
+      rules.device.ruleCount + rules.os.ruleCount + rules.browser.ruleCount);
+  add_fingerprint(fingerprint, "browser", rules.browser.ruleCount);
+  fill_stores(rules.browser,
+              browserStore,
+              browserSnippetIndex,
+              browserMapping,
+              pattern,
+              fingerprint);
+  add_fingerprint(fingerprint, "os", rules.os.ruleCount);
+  fill_stores(
+      rules.os, osStore, osSnippetIndex, osMapping, pattern, fingerprint);
+  add_fingerprint(fingerprint, "device", rules.device.ruleCount);
+  fill_stores(rules.device,
+              deviceStore,
+              deviceSnippetIndex,
+              deviceMapping,
+              pattern,
+              fingerprint);
+  add_fingerprint(fingerprint, pattern);
+}
+
+void UAStore::load(const RuleDefinitions& rules, const ParserOptions& options) {
+  const auto pattern = pattern_options(
+      options, rules.device.size() + rules.os.size() + rules.browser.size());
+  add_fingerprint(fingerprint, "browser", rules.browser.size());
+  fill_stores(rules.browser,
+              browserStore,
+              browserSnippetIndex,
+              browserMapping,
+              pattern,
+              fingerprint);
+  add_fingerprint(fingerprint, "os", rules.os.size());
+  fill_stores(
+      rules.os, osStore, osSnippetIndex, osMapping, pattern, fingerprint);
+  add_fingerprint(fingerprint, "device", rules.device.size());
+  fill_stores(rules.device,
+              deviceStore,
+              deviceSnippetIndex,
+              deviceMapping,
+              pattern,
+              fingerprint);
+  add_fingerprint(fingerprint, pattern);
+}
+
+}  // namespace uap_cpp
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../UaParser"
+#include "BuiltinRules.h"
+#include "Pattern.h"
+#include "ReplaceTemplate.h"
+#include "RuleDefinitions.h"
+#include "SnippetIndex.h"
+#include "SnippetMapping.h"
+
+namespace uap_cpp {
+
+struct GenericStore {
+  ReplaceTemplate replacement;
+  Pattern regExpr;
+  int index{0};
+};
+
+struct DeviceStore : GenericStore {
+  ReplaceTemplate brandReplacement;
+  ReplaceTemplate modelReplacement;
+};
+
+struct AgentStore : GenericStore {
+  ReplaceTemplate majorVersionReplacement;
+  ReplaceTemplate minorVersionReplacement;
+  ReplaceTemplate patchVersionReplacement;
+  ReplaceTemplate patchMinorVersionReplacement;
+};
+
+struct GenericStoreComparator {
+  bool operator()(const GenericStore* lhs, const GenericStore* rhs) const {
+    return lhs->index < rhs->index;
+  }
+};
+
+/**
+ * Rules loaded from regexes.yaml, with a snippet index and mapping per
+ * category to find the candidate rules for an input string.
+ *
+ * The rules of a category are stored contiguously, in regexes.yaml order, and
+ * the indexes and mappings are frozen once all rules are loaded.
+ */
+struct UAStore {
+  /**
+   * Regexes are compiled with the re2 settings of the options, and the rules
+   * are reduced to the subset the options select, whatever their source.
+   * Use RuleSubset::withAllRules() to load all of them.
+   */
+  explicit UAStore(const std::string& regexes_file_path,
+                   const ParserOptions& = ParserOptions());
+  explicit UAStore(const RuleDefinitions&,
+                   const ParserOptions& = ParserOptions());
+
+  /**
+   * Uses the generated indexes in place, only the regexes and replacement
+   * templates are compiled, unless a subset is selected
+   */
+  explicit UAStore(const BuiltinRules&, const ParserOptions& = ParserOptions());
+
+  UAStore(const UAStore&) = delete;
+  UAStore& operator=(const UAStore&) = delete;
+
+  std::vector<DeviceStore> deviceStore;
+  std::vector<AgentStore> osStore;
+  std::vector<AgentStore> browserStore;
+
+  SnippetIndex deviceSnippetIndex;
+  SnippetIndex osSnippetIndex;
+  SnippetIndex browserSnippetIndex;
+
+  SnippetMapping<const DeviceStore*> deviceMapping;
+  SnippetMapping<const AgentStore*> osMapping;
+  SnippetMapping<const AgentStore*> browserMapping;
+
+  /**
+   * Hash of the rules of each category, in order, and of the options that
+   * change results, to tell results of different rules apart in caches that
+   * outlive the parser
+   */
+  uint64_t fingerprint{0};
+
+ private:
+  void load(const RuleDefinitions&, const ParserOptions&);
+};
+
+}  // namespace uap_cpp
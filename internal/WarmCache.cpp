@@ -0,0 +1,210 @@
+#include "WarmCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "CompactResult.h"
+#include "Hash.h"
+
+#ifndef _WIN32
+#include "MappedFile.h"
+#endif
+
+namespace uap_cpp {
+
+namespace {
+
+constexpr char MAGIC[8] = {'u', 'a', 'p', 'w', 'a', 'r', 'm', '\0'};
+constexpr uint32_t VERSION = 2;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t fingerprint;
+  uint64_t bucketCount;
+  uint64_t entryCount;
+};
+
+// Every entry starts with its hash and the size of its encoded result
+constexpr size_t ENTRY_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+
+template <class T>
+T read(const char* p) {
+  T value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+template <class T>
+void write(std::string& out, T value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}  // namespace
+
+WarmCache::WarmCache(const std::string& path) {
+  std::string_view data;
+#ifdef _WIN32
+  std::ifstream input(path, std::ios::binary);
+  if (!input) {
+    return;
+  }
+  contents_.assign(std::istreambuf_iterator<char>(input),
+                   std::istreambuf_iterator<char>());
+  data = contents_;
+#else
+  if (!MappedFile::isRegularFile(path)) {
+    return;
+  }
+  file_.reset(new MappedFile(path, false));
+  data = file_->data();
+#endif
+
+  // Files from other versions are left unused, they are replaced by the next
+  // save
+  Header header;
+  if (data.size() >= sizeof(Header)) {
+    header = read<Header>(data.data());
+  }
+  if (data.size() < sizeof(Header) ||
+      memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION ||
+      header.bucketCount == 0 ||
+      (header.bucketCount & (header.bucketCount - 1)) != 0 ||
+      header.bucketCount >= (data.size() - sizeof(Header)) / sizeof(uint64_t)) {
+#ifdef _WIN32
+    contents_.clear();
+#else
+    file_.reset();
+#endif
+    return;
+  }
+
+  const size_t buckets_size = (header.bucketCount + 1) * sizeof(uint64_t);
+  buckets_ = data.data() + sizeof(Header);
+  bucketCount_ = header.bucketCount;
+  entries_ = data.substr(sizeof(Header) + buckets_size);
+  entryCount_ = header.entryCount;
+  fingerprint_ = header.fingerprint;
+}
+
+WarmCache::~WarmCache() {}
+
+size_t WarmCache::mappedBytes() const {
+#ifdef _WIN32
+  return contents_.size();
+#else
+  return file_ ? file_->data().size() : 0;
+#endif
+}
+
+bool WarmCache::find(std::string_view ua,
+                     uint64_t hash,
+                     UserAgent& result) const {
+  if (!bucketCount_) {
+    return false;
+  }
+
+  const size_t bucket = hash & (bucketCount_ - 1);
+  size_t pos = read<uint64_t>(buckets_ + bucket * sizeof(uint64_t));
+  const size_t end = std::min<uint64_t>(
+      read<uint64_t>(buckets_ + (bucket + 1) * sizeof(uint64_t)),
+      entries_.size());
+  // Offsets come from the file, which may be damaged: pos + n could wrap
+  while (pos <= end && end - pos >= ENTRY_HEADER_SIZE) {
+    const auto entry_hash = read<uint64_t>(entries_.data() + pos);
+    const auto size = read<uint32_t>(entries_.data() + pos + sizeof(uint64_t));
+    pos += ENTRY_HEADER_SIZE;
+    if (size > end - pos) {
+      return false;
+    }
+    if (entry_hash == hash &&
+        CompactResult::decode(entries_.substr(pos, size), ua, result)) {
+      return true;
+    }
+    pos += size;
+  }
+  return false;
+}
+
+size_t WarmCache::save(
+    const std::string& path,
+    uint64_t fingerprint,
+    const std::vector<std::pair<std::string, UserAgent>>& results) {
+  struct Entry {
+    uint64_t hash;
+    const std::string* ua;
+    const UserAgent* result;
+    size_t size;
+  };
+  std::vector<Entry> entries;
+  entries.reserve(results.size());
+  for (const auto& r : results) {
+    const size_t size = CompactResult::encodedSize(r.first, r.second);
+    if (size) {
+      entries.push_back(
+          {hash64(r.first, fingerprint), &r.first, &r.second, size});
+    }
+  }
+
+  uint64_t bucket_count = 1;
+  while (bucket_count < entries.size()) {
+    bucket_count <<= 1;
+  }
+  const uint64_t mask = bucket_count - 1;
+  std::stable_sort(
+      entries.begin(), entries.end(), [mask](const Entry& a, const Entry& b) {
+        return (a.hash & mask) < (b.hash & mask);
+      });
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.fingerprint = fingerprint;
+  header.bucketCount = bucket_count;
+  header.entryCount = entries.size();
+
+  std::string buckets;
+  std::string data;
+  size_t entry = 0;
+  for (uint64_t bucket = 0; bucket <= bucket_count; ++bucket) {
+    write<uint64_t>(buckets, data.size());
+    for (; entry < entries.size() && (entries[entry].hash & mask) == bucket;
+         ++entry) {
+      const Entry& e = entries[entry];
+      write<uint64_t>(data, e.hash);
+      write<uint32_t>(data, static_cast<uint32_t>(e.size));
+      const size_t offset = data.size();
+      data.resize(offset + e.size);
+      CompactResult::encode(*e.ua, *e.result, &data[offset]);
+    }
+  }
+
+  const std::string temporary_path = path + ".tmp";
+  {
+    std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output << buckets << data;
+    if (!output.flush()) {
+      std::remove(temporary_path.c_str());
+      throw std::runtime_error("Cannot write " + temporary_path);
+    }
+  }
+#ifdef _WIN32
+  // Renaming does not replace existing files; loaded caches are in memory
+  std::remove(path.c_str());
+#endif
+  if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+    std::remove(temporary_path.c_str());
+    throw std::runtime_error("Cannot replace " + path);
+  }
+  return entries.size();
+}
+
+}  // namespace uap_cpp
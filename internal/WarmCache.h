@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../UaParser"
+
+namespace uap_cpp {
+
+class MappedFile;
+
+/**
+ * Read-only table of parse results saved to a file, to start a parser with
+ * the results of the previous run instead of an empty cache.
+ *
+ * The file holds a hash table of results encoded with CompactResult: a
+ * header with the fingerprint of the rules the results were parsed with,
+ * the offsets of the buckets, and the entries grouped by bucket. It is
+ * memory-mapped and used in place.
+ */
+class WarmCache {
+ public:
+  /**
+   * Loads the file if it exists and is in the current format; otherwise the
+   * cache is empty. Throws if the file exists but cannot be read.
+   */
+  explicit WarmCache(const std::string& path);
+  ~WarmCache();
+
+  WarmCache(const WarmCache&) = delete;
+  WarmCache& operator=(const WarmCache&) = delete;
+
+  /**
+   * hash is the hash of ua seeded with the rules fingerprint, as for
+   * SharedCache
+   */
+  bool find(std::string_view ua, uint64_t hash, UserAgent& result) const;
+
+  size_t size() const { return entryCount_; }
+
+  /**
+   * Fingerprint of the rules the results were parsed with. The results are
+   * only valid for a parser with the same fingerprint.
+   */
+  uint64_t fingerprint() const { return fingerprint_; }
+  size_t mappedBytes() const;
+
+  /**
+   * Writes results to path, through a temporary file renamed over it so that
+   * running parsers keep their mapping of the old file. Results that cannot
+   * be encoded are skipped. Returns the number of results written.
+   */
+  static size_t save(
+      const std::string& path,
+      uint64_t fingerprint,
+      const std::vector<std::pair<std::string, UserAgent>>& results);
+
+ private:
+#ifdef _WIN32
+  // Contents of the file, there is no MappedFile on Windows
+  std::string contents_;
+#else
+  std::unique_ptr<MappedFile> file_;
+#endif
+
+  const char* buckets_{nullptr};
+  uint64_t bucketCount_{0};
+  std::string_view entries_;
+  size_t entryCount_{0};
+  uint64_t fingerprint_{0};
+};
+
+}  // namespace uap_cpp
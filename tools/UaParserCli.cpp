@@ -0,0 +1,244 @@
+#include "../UaParser"
+#include "../internal/BlockPipeline.h"
+#include "../internal/MappedFile.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Exit status of invalid arguments, as for most command-line tools
+constexpr int USAGE_ERROR = 2;
+
+void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options] <regexes.yaml> [input file]\n"
+          "\n"
+          "Parses one user agent string per line and writes one result per "
+          "line,\nin input order. Reads stdin when no input file (or \"-\") "
+          "is given.\n"
+          "\n"
+          "  -f tsv|json  output format (default: tsv)\n"
+          "  -c columns   comma-separated TSV columns, e.g. "
+          "browser_family,os_family\n"
+          "  -H           write a TSV header line\n"
+          "  -l           access log mode: input lines are access log lines, "
+          "written\n"
+          "               back with the parsed columns appended after a tab\n"
+          "  -u index     zero-based quoted field holding the user agent in "
+          "access log\n"
+          "               mode (default: 2, as in the combined log format)\n"
+          "  -t threads   number of parser threads (default: all cores)\n"
+          "  -b bytes     input block size (default: 1048576)\n",
+          program);
+}
+
+bool parse_columns(const std::string& spec,
+                   std::vector<uap_cpp::Field>& columns) {
+  columns.clear();
+  size_t start = 0;
+  while (start <= spec.size()) {
+    size_t end = spec.find(',', start);
+    if (end == std::string::npos) {
+      end = spec.size();
+    }
+    const std::string name = spec.substr(start, end - start);
+
+    bool found = false;
+    for (int i = 0; i <= static_cast<int>(uap_cpp::Field::kBrowserPatchMinor);
+         ++i) {
+      const auto field = static_cast<uap_cpp::Field>(i);
+      if (name == uap_cpp::field_name(field)) {
+        columns.push_back(field);
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      fprintf(stderr, "Unknown column: %s\n", name.c_str());
+      return false;
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool json = false;
+  bool header = false;
+  bool log_mode = false;
+  int user_agent_field = 2;
+  unsigned threads = 0;
+  size_t block_size = 1 << 20;
+
+  std::vector<uap_cpp::Field> columns;
+  bool has_columns = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:c:Hlu:t:b:")) != -1) {
+    switch (opt) {
+      case 'f':
+        if (strcmp(optarg, "json") == 0) {
+          json = true;
+        } else if (strcmp(optarg, "tsv") != 0) {
+          usage(argv[0]);
+          return USAGE_ERROR;
+        }
+        break;
+      case 'c':
+        if (!parse_columns(optarg, columns)) {
+          return USAGE_ERROR;
+        }
+        has_columns = true;
+        break;
+      case 'H':
+        header = true;
+        break;
+      case 'l':
+        log_mode = true;
+        break;
+      case 'u':
+        user_agent_field = atoi(optarg);
+        break;
+      case 't':
+        threads = static_cast<unsigned>(atoi(optarg));
+        break;
+      case 'b':
+        block_size = static_cast<size_t>(atoll(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return USAGE_ERROR;
+    }
+  }
+  if (argc - optind < 1 || argc - optind > 2) {
+    usage(argv[0]);
+    return USAGE_ERROR;
+  }
+  const std::string regexes_path = argv[optind];
+  const std::string input_path = argc - optind == 2 ? argv[optind + 1] : "-";
+
+  if (!has_columns) {
+    // Plain user agent input is echoed as the first column
+    if (!log_mode) {
+      columns.push_back(uap_cpp::Field::kUserAgentString);
+    }
+    columns.insert(columns.end(),
+                   uap_cpp::default_columns().begin(),
+                   uap_cpp::default_columns().end());
+  }
+
+  // Categories without a TSV column are not loaded
+  uap_cpp::ParserOptions parser_options;
+  if (!json) {
+    auto has_column = [&](uap_cpp::Field first, uap_cpp::Field last) {
+      for (auto field : columns) {
+        if (first <= field && field <= last) {
+          return true;
+        }
+      }
+      return false;
+    };
+    parser_options.load_device_rules = has_column(
+        uap_cpp::Field::kDeviceFamily, uap_cpp::Field::kDeviceModel);
+    parser_options.load_os_rules =
+        has_column(uap_cpp::Field::kOsFamily, uap_cpp::Field::kOsPatchMinor);
+    parser_options.load_browser_rules = has_column(
+        uap_cpp::Field::kBrowserFamily, uap_cpp::Field::kBrowserPatchMinor);
+  }
+
+  try {
+    uap_cpp::UserAgentParser parser(regexes_path, parser_options);
+
+    // Regular files are mapped and split in place, anything else is streamed
+    std::unique_ptr<uap_cpp::MappedFile> mapped_file;
+    std::ifstream input_file;
+    std::istream* input = &std::cin;
+    if (input_path != "-" && uap_cpp::MappedFile::isRegularFile(input_path)) {
+      mapped_file.reset(new uap_cpp::MappedFile(input_path));
+    } else if (input_path != "-") {
+      input_file.open(input_path, std::ios::binary);
+      if (!input_file) {
+        fprintf(stderr, "Cannot open %s\n", input_path.c_str());
+        return EXIT_FAILURE;
+      }
+      input = &input_file;
+    } else {
+      std::ios::sync_with_stdio(false);
+    }
+
+    if (header && !json) {
+      std::string line;
+      uap_cpp::append_tsv_header(columns, line);
+      line += '\n';
+      fwrite(line.data(), 1, line.size(), stdout);
+    }
+
+    auto write = [](std::string_view output) {
+      if (fwrite(output.data(), 1, output.size(), stdout) != output.size()) {
+        throw std::runtime_error("Error while writing output");
+      }
+    };
+
+    if (log_mode) {
+      uap_cpp::LogEnrichOptions options;
+      options.columns = columns;
+      options.json = json;
+      options.user_agent_field = user_agent_field;
+      options.threads = threads;
+      options.block_size = block_size;
+      if (mapped_file) {
+        uap_cpp::enrich_log(parser, mapped_file->data(), write, options);
+      } else {
+        uap_cpp::enrich_log(parser, *input, write, options);
+      }
+    } else {
+      std::unique_ptr<uap_cpp::BlockReader> reader;
+      if (mapped_file) {
+        reader.reset(
+            new uap_cpp::MemoryBlockReader(mapped_file->data(), block_size));
+      } else {
+        reader.reset(new uap_cpp::StreamBlockReader(*input, block_size));
+      }
+
+      uap_cpp::BlockPipeline::run(
+          *reader,
+          [&](std::string_view block, std::string& output) {
+            thread_local uap_cpp::UserAgent result;
+            output.reserve(block.size() * 2);
+            uap_cpp::for_each_line(block, [&](std::string_view line) {
+              parser.parse(line, result);
+              if (json) {
+                uap_cpp::append_json(result, output);
+              } else {
+                uap_cpp::append_tsv(result, columns, output);
+              }
+              output += '\n';
+            });
+          },
+          [&](const std::string& output) { write(output); },
+          threads);
+    }
+
+    if (fflush(stdout) != 0) {
+      throw std::runtime_error("Error while writing output");
+    }
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,225 @@
+#include "../internal/BuiltinRules.h"
+#include "../internal/RuleDefinitions.h"
+#include "../internal/UAStore.h"
+
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Compiles regexes.yaml into a C++ source defining uap_cpp::builtin_rules():
+ * the rules and the frozen snippet indexes and mappings as constant tables.
+ * Run by the build when the BUILTIN_RULES CMake option is set.
+ */
+
+namespace {
+
+using uap_cpp::RuleDefinition;
+using uap_cpp::SnippetIndex;
+using uap_cpp::SnippetMapping;
+using uap_cpp::UAStore;
+
+std::string literal(const std::string& s) {
+  std::string out = "\"";
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += static_cast<char>(c);
+    } else if (c < ' ' || c >= 0x7f) {
+      // Octal escapes, always three digits so that a following digit is not
+      // taken as part of them
+      char escaped[5];
+      snprintf(escaped, sizeof(escaped), "\\%03o", c);
+      out += escaped;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  out += '"';
+  return out;
+}
+
+std::string literal(const std::optional<std::string>& s) {
+  return s ? literal(*s) : "nullptr";
+}
+
+/**
+ * Writes an array definition, with a single zero element when empty since
+ * C++ has no empty arrays
+ */
+template <class T>
+void write_array(std::ostream& out,
+                 const char* type,
+                 const std::string& name,
+                 const T* values,
+                 size_t count) {
+  out << "const " << type << " " << name << "[] = {";
+  if (!count) {
+    out << "0";
+  }
+  for (size_t i = 0; i < count; ++i) {
+    out << (i % 16 == 0 ? "\n    " : " ") << +values[i] << ",";
+  }
+  out << "};\n\n";
+}
+
+template <class Store>
+void write_category(std::ostream& out,
+                    const std::string& name,
+                    const std::vector<RuleDefinition>& rules,
+                    const SnippetIndex& index,
+                    const SnippetMapping<const Store*>& mapping,
+                    std::string& initializer) {
+  const std::string prefix = "k" + name;
+
+  out << "const BuiltinRule " << prefix << "Rules[] = {\n";
+  for (const auto& rule : rules) {
+    out << "    {" << literal(rule.regex) << ",\n     "
+        << (rule.caseInsensitive ? "true" : "false") << ",\n     {";
+    for (int r = 0; r < 4; ++r) {
+      out << (r ? ", " : "") << literal(rule.replacements[r]);
+    }
+    out << "}},\n";
+  }
+  if (rules.empty()) {
+    out << "    {nullptr, false, {nullptr, nullptr, nullptr, nullptr}},\n";
+  }
+  out << "};\n\n";
+
+  const auto tables = index.tables();
+  write_array(out, "uint8_t", prefix + "ByteClasses", tables.byteClasses, 256);
+  write_array(out,
+              "uint32_t",
+              prefix + "Transitions",
+              tables.transitions,
+              tables.nodeCount * tables.classCount);
+  write_array(out,
+              "uint32_t",
+              prefix + "SnippetIds",
+              tables.snippetIds,
+              tables.nodeCount);
+
+  const auto snippets = index.getRegisteredSnippets();
+  out << "const char* const " << prefix << "Snippets[] = {\n";
+  for (size_t id = 1; id <= snippets.size(); ++id) {
+    out << "    " << literal(snippets.at(id)) << ",\n";
+  }
+  if (snippets.empty()) {
+    out << "    nullptr,\n";
+  }
+  out << "};\n\n";
+
+  const auto& mapping_tables = mapping.tables();
+  out << "const SnippetMappingNode " << prefix << "MappingNodes[] = {\n";
+  for (size_t i = 0; i < mapping_tables.nodeCount; ++i) {
+    const auto& node = mapping_tables.nodes[i];
+    out << "    {" << node.firstTransition << ", " << node.lastTransition
+        << ", " << node.firstExpression << ", " << node.lastExpression
+        << "},\n";
+  }
+  if (!mapping_tables.nodeCount) {
+    out << "    {0, 0, 0, 0},\n";
+  }
+  out << "};\n\n";
+  write_array(out,
+              "uint32_t",
+              prefix + "MappingSnippets",
+              mapping_tables.transitionSnippets,
+              mapping_tables.transitionCount);
+  write_array(out,
+              "uint32_t",
+              prefix + "MappingTargets",
+              mapping_tables.transitionTargets,
+              mapping_tables.transitionCount);
+
+  std::vector<uint32_t> mapping_rules;
+  for (const auto* store : mapping.expressions()) {
+    mapping_rules.push_back(store->index - 1);
+  }
+  write_array(out,
+              "uint32_t",
+              prefix + "MappingRules",
+              mapping_rules.data(),
+              mapping_rules.size());
+
+  std::ostringstream init;
+  init << "    {" << prefix << "Rules,\n     " << rules.size() << ",\n     {"
+       << prefix << "ByteClasses,\n      " << tables.classCount << ",\n      "
+       << prefix << "Transitions,\n      " << prefix << "SnippetIds,\n      "
+       << tables.nodeCount << ",\n      " << prefix << "Snippets,\n      "
+       << snippets.size() << "},\n     {" << prefix << "MappingNodes,\n      "
+       << mapping_tables.nodeCount << ",\n      " << prefix
+       << "MappingSnippets,\n      " << prefix << "MappingTargets,\n      "
+       << mapping_tables.transitionCount << "},\n     " << prefix
+       << "MappingRules,\n     " << mapping_rules.size() << "},\n";
+  initializer += init.str();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <regexes.yaml> <output.cpp>\n", argv[0]);
+    return -1;
+  }
+
+  try {
+    const auto rules = uap_cpp::RuleDefinitions::load(argv[1]);
+    const UAStore store(rules);
+
+    std::ostringstream out;
+    out << "// Generated from " << argv[1] << " by uap-rules-gen, do not edit\n"
+        << "\n"
+        << "#include \"internal/BuiltinRules.h\"\n"
+        << "\n"
+        << "namespace uap_cpp {\n"
+        << "\n"
+        << "namespace {\n"
+        << "\n";
+
+    std::string initializer;
+    write_category(out,
+                   "Device",
+                   rules.device,
+                   store.deviceSnippetIndex,
+                   store.deviceMapping,
+                   initializer);
+    write_category(out,
+                   "Os",
+                   rules.os,
+                   store.osSnippetIndex,
+                   store.osMapping,
+                   initializer);
+    write_category(out,
+                   "Browser",
+                   rules.browser,
+                   store.browserSnippetIndex,
+                   store.browserMapping,
+                   initializer);
+
+    out << "const BuiltinRules kRules = {\n"
+        << initializer << "};\n"
+        << "\n"
+        << "}  // namespace\n"
+        << "\n"
+        << "const BuiltinRules& builtin_rules() {\n"
+        << "  return kRules;\n"
+        << "}\n"
+        << "\n"
+        << "}  // namespace uap_cpp\n";
+
+    std::ofstream output(argv[2], std::ios::binary);
+    output << out.str();
+    if (!output.flush()) {
+      fprintf(stderr, "Cannot write %s\n", argv[2]);
+      return 1;
+    }
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
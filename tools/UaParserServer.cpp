@@ -0,0 +1,124 @@
+#include "../UaParser"
+#include "../internal/ParserServer.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <thread>
+
+namespace {
+
+void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options] <regexes.yaml>\n"
+          "\n"
+          "Loads the rules once and parses user agents for other processes "
+          "over a Unix\ndomain socket (see ParserClient), until SIGINT or "
+          "SIGTERM.\n"
+          "\n"
+          "  -s path      socket path (default: /tmp/uap.sock)\n"
+          "  -t threads   number of parser threads (default: all cores)\n"
+          "  -b requests  largest batch of requests parsed by one thread "
+          "(default: 64)\n"
+          "  -m clients   most connections served at once, others wait "
+          "(default: 256)\n"
+          "  -c path      shared result cache file "
+          "(ParserOptions::shared_cache_path)\n"
+          "  -e entries   shared result cache entries (default: 65536)\n"
+          "  -w           warm up the parser before accepting connections\n",
+          program);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string socket_path = "/tmp/uap.sock";
+  unsigned threads = 0;
+  size_t batch = 64;
+  size_t connections = 256;
+  bool warm_up = false;
+  uap_cpp::ParserOptions options;
+  options.shared_cache_entries = 1 << 16;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:t:b:m:c:e:w")) != -1) {
+    switch (opt) {
+      case 's':
+        socket_path = optarg;
+        break;
+      case 't':
+        threads = static_cast<unsigned>(atoi(optarg));
+        break;
+      case 'b':
+        batch = static_cast<size_t>(atoll(optarg));
+        break;
+      case 'm':
+        connections = static_cast<size_t>(atoll(optarg));
+        break;
+      case 'c':
+        options.shared_cache_path = optarg;
+        break;
+      case 'e':
+        options.shared_cache_entries = static_cast<size_t>(atoll(optarg));
+        break;
+      case 'w':
+        warm_up = true;
+        break;
+      default:
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (argc - optind != 1) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Signals are handled by sigwait() below, not by the server threads
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  try {
+    const uap_cpp::UserAgentParser parser(argv[optind], options);
+    if (warm_up) {
+      const auto report = parser.warm_up({}, threads ? threads : 1);
+      fprintf(stderr,
+              "Warmed up with %zu user agents in %.1f ms\n",
+              report.user_agents,
+              report.nanoseconds / 1e6);
+    }
+
+    uap_cpp::ParserServer server(
+        parser, socket_path, threads, batch, connections);
+    std::thread waiter([&] {
+      int signal_number;
+      sigwait(&signals, &signal_number);
+      server.stop();
+    });
+    fprintf(stderr, "Listening on %s\n", socket_path.c_str());
+    try {
+      server.run();
+    } catch (...) {
+      // The waiter only returns on a signal
+      pthread_kill(waiter.native_handle(), SIGTERM);
+      waiter.join();
+      throw;
+    }
+    waiter.join();
+    fprintf(stderr, "Parsed %llu requests\n",
+            static_cast<unsigned long long>(server.parsed()));
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return -1;
+  }
+  return 0;
+}